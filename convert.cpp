@@ -0,0 +1,291 @@
+// convert - batch conversion between FEN/EPD text and BoardPacked files
+//
+// usage: convert [-t threads] [-batch mb] [-mem mb] [-identity] [-verify] in out
+//
+// The format of each file is taken from its name:
+//   .pks  a PackStore - sorted and duplicate-free, so writing one sorts
+//         and dedups the input (in -mem of RAM, spilling if need be)
+//   .bpk  raw 32-byte BoardPacked records, in input order
+//   else  text, one FEN or EPD position per line
+// The input is read -batch MB at a time, parsed or formatted on all the
+// pool's threads (-t, 0 for one per hardware thread), and written in
+// input order with large sequential writes. Malformed text lines are
+// reported and skipped. -identity packs positions read from text with
+// pack_identity(). -verify reads the output back and checks it holds
+// every input position - compared by FEN when the output is text, as
+// text can't carry everything a packed record does.
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "garth.h"
+#include "epd.h"
+
+typedef std::chrono::steady_clock Clock;
+
+enum Format { FMT_TEXT, FMT_RAW, FMT_STORE };
+
+static Format format_of( const std::string& path ) {
+    auto ends_with = [&path]( const char *ext ) {
+        size_t n = std::strlen(ext);
+        return path.size() >= n && path.compare( path.size() - n, n, ext ) == 0;
+    };
+    if ( ends_with(".pks") ) return FMT_STORE;
+    if ( ends_with(".bpk") ) return FMT_RAW;
+    return FMT_TEXT;
+}
+
+// Source - the records of a file, a batch at a time in file order
+class Source {
+public:
+    virtual ~Source() {}
+    virtual bool open( const std::string& path ) = 0;
+    // false once there are no more
+    virtual bool next( ThreadPool& pool, BoardPackedList& batch ) = 0;
+    uint64_t errors() const { return _errors; }
+    void     quiet() { _quiet = true; }     // count errors without printing them
+protected:
+    uint64_t _errors = 0;
+    bool     _quiet  = false;
+};
+
+class TextSource : public Source {
+public:
+    TextSource( size_t bytes, bool identity ) : _bytes(bytes), _identity(identity) {}
+    bool open( const std::string& path ) override { return _file.open(path); }
+    bool next( ThreadPool& pool, BoardPackedList& batch ) override {
+        EpdErrorList errs;
+        while ( _file.load_next( pool, batch, _bytes, &errs, _identity ) ) {
+            for ( auto& e : errs )
+                if ( _errors++ < 10 && !_quiet )
+                    std::cerr << "line " << e.line << " col " << e.col << ": " << e.msg << std::endl;
+            if ( !batch.empty() )
+                return true;
+        }
+        return false;
+    }
+private:
+    EpdFile _file;
+    size_t  _bytes;
+    bool    _identity;
+};
+
+class RawSource : public Source {
+public:
+    RawSource( size_t bytes ) : _fd(-1), _cnt( std::max<size_t>( bytes / sizeof(BoardPacked), 1 ) ) {}
+    ~RawSource() { if ( _fd >= 0 ) ::close(_fd); }
+    bool open( const std::string& path ) override {
+        _fd = ::open( path.c_str(), O_RDONLY );
+        return _fd >= 0;
+    }
+    bool next( ThreadPool&, BoardPackedList& batch ) override {
+        batch.resize(_cnt);
+        uint8_t *p = batch[0].b;
+        size_t   want( _cnt * sizeof(BoardPacked) ), got(0);
+        while ( got < want ) {
+            ssize_t n = ::read( _fd, p + got, want - got );
+            if ( n <= 0 )
+                break;
+            got += n;
+        }
+        if ( got % sizeof(BoardPacked) ) {
+            std::cerr << "convert: raw input ends in a partial record" << std::endl;
+            _errors++;
+        }
+        batch.resize( got / sizeof(BoardPacked) );
+        return !batch.empty();
+    }
+private:
+    int    _fd;
+    size_t _cnt;
+};
+
+class StoreSource : public Source {
+public:
+    StoreSource( size_t bytes ) : _pos(0), _cnt( std::max<size_t>( bytes / sizeof(BoardPacked), 1 ) ) {}
+    bool open( const std::string& path ) override { return _store.open(path); }
+    bool next( ThreadPool&, BoardPackedList& batch ) override {
+        size_t n = std::min<uint64_t>( _cnt, _store.size() - _pos );
+        batch.assign( _store.begin() + _pos, _store.begin() + _pos + n );
+        _pos += n;
+        return n != 0;
+    }
+    const PackStore& store() const { return _store; }
+private:
+    PackStore _store;
+    uint64_t  _pos;
+    size_t    _cnt;
+};
+
+static std::unique_ptr<Source> make_source( Format fmt, size_t bytes, bool identity ) {
+    switch ( fmt ) {
+    case FMT_TEXT:  return std::make_unique<TextSource>( bytes, identity );
+    case FMT_RAW:   return std::make_unique<RawSource>( bytes );
+    case FMT_STORE: return std::make_unique<StoreSource>( bytes );
+    }
+    return nullptr;
+}
+
+// write every record of src to out, returning false on any failure
+static bool convert( Source& src, Format fmt, const std::string& out, size_t ram_mb,
+                     ThreadPool& pool, uint64_t& cnt, uint64_t& written ) {
+    BoardPackedList batch;
+    cnt = written = 0;
+    if ( fmt == FMT_STORE ) {
+        // the sorter spills its runs beside the output
+        size_t      slash = out.find_last_of('/');
+        std::string dir   = ( slash == std::string::npos ) ? "." : out.substr( 0, slash );
+        PackSorter      sorter( ram_mb, dir );
+        PackStoreWriter w;
+        while ( src.next( pool, batch ) ) {
+            cnt += batch.size();
+            if ( !sorter.add( batch.data(), batch.size() ) )
+                return false;
+        }
+        if ( !w.open(out) || !sorter.finish(w) || !w.close() )
+            return false;
+        written = w.count();
+        return true;
+    }
+
+    int fd = ::open( out.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644 );
+    if ( fd < 0 )
+        return false;
+    bool ok(true);
+    while ( ok && src.next( pool, batch ) ) {
+        cnt += batch.size();
+        ok = ( fmt == FMT_TEXT ) ? write_fens( pool, fd, batch.data(), batch.size() )
+                                 : write_all( fd, batch.data(), batch.size() * sizeof(BoardPacked) );
+    }
+    written = cnt;
+    return ( ::close(fd) == 0 ) && ok;
+}
+
+static bool same_fen( const BoardPacked& a, const BoardPacked& b ) {
+    char fa[FEN_MAX], fb[FEN_MAX];
+    Board(a).fen_to(fa);
+    Board(b).fen_to(fb);
+    return std::strcmp( fa, fb ) == 0;
+}
+
+// read the input and output back, checking the output holds every input
+// record, returning the number that don't match
+static uint64_t verify( Source& in, Format out_fmt, const std::string& out, size_t bytes,
+                        ThreadPool& pool ) {
+    std::unique_ptr<Source> res = make_source( out_fmt, bytes, false );
+    res->quiet();
+    if ( !res->open(out) ) {
+        std::cerr << "convert: can't read back " << out << std::endl;
+        return 1;
+    }
+    uint64_t        bad(0), idx(0);
+    BoardPackedList a, b;
+    size_t          pos(0);
+    if ( out_fmt == FMT_STORE ) {
+        // sorted and deduplicated, so look each record up
+        const PackStore& store = static_cast<StoreSource&>(*res).store();
+        while ( in.next( pool, a ) )
+            for ( auto& rec : a )
+                bad += !store.contains(rec);
+        return bad;
+    }
+    while ( in.next( pool, a ) ) {
+        for ( auto& rec : a ) {
+            if ( pos == b.size() ) {
+                pos = 0;
+                if ( !res->next( pool, b ) ) {
+                    std::cerr << "convert: output is short by " << a.size() - ( &rec - a.data() ) << "+ records" << std::endl;
+                    return bad + 1;
+                }
+            }
+            bool ok = ( out_fmt == FMT_TEXT ) ? same_fen( rec, b[pos] ) : rec == b[pos];
+            if ( !ok && bad++ < 10 )
+                std::cerr << "convert: record " << idx << " differs" << std::endl;
+            pos++;
+            idx++;
+        }
+    }
+    if ( pos != b.size() || res->next( pool, b ) ) {
+        std::cerr << "convert: output has extra records" << std::endl;
+        bad++;
+    }
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    int         threads(0);
+    size_t      batch_mb(64);
+    size_t      ram_mb(256);
+    bool        identity(false);
+    bool        check(false);
+    std::string in, out;
+
+    for ( int idx(1); idx < argc; ++idx ) {
+        if ( !std::strcmp( argv[idx], "-t" ) && idx + 1 < argc ) {
+            threads = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-batch" ) && idx + 1 < argc ) {
+            batch_mb = std::max( 1, std::atoi( argv[++idx] ) );
+        } else if ( !std::strcmp( argv[idx], "-mem" ) && idx + 1 < argc ) {
+            ram_mb = std::max( 1, std::atoi( argv[++idx] ) );
+        } else if ( !std::strcmp( argv[idx], "-identity" ) ) {
+            identity = true;
+        } else if ( !std::strcmp( argv[idx], "-verify" ) ) {
+            check = true;
+        } else if ( argv[idx][0] != '-' && in.empty() ) {
+            in = argv[idx];
+        } else if ( argv[idx][0] != '-' && out.empty() ) {
+            out = argv[idx];
+        } else {
+            in.clear();
+            break;
+        }
+    }
+    if ( in.empty() || out.empty() ) {
+        std::cerr << "usage: convert [-t threads] [-batch mb] [-mem mb] [-identity] [-verify] in out" << std::endl;
+        return 2;
+    }
+
+    ThreadPool pool( threads );
+    Format     in_fmt  = format_of(in);
+    Format     out_fmt = format_of(out);
+    size_t     bytes   = batch_mb << 20;
+
+    std::unique_ptr<Source> src = make_source( in_fmt, bytes, identity );
+    if ( !src->open(in) ) {
+        std::cerr << "convert: can't read " << in << std::endl;
+        return 1;
+    }
+    auto     start = Clock::now();
+    uint64_t cnt, written;
+    if ( !convert( *src, out_fmt, out, ram_mb, pool, cnt, written ) ) {
+        std::cerr << "convert: failed writing " << out << std::endl;
+        return 1;
+    }
+    double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+    std::cout << cnt << " positions";
+    if ( written != cnt )
+        std::cout << " (" << written << " distinct)";
+    if ( src->errors() )
+        std::cout << ", " << src->errors() << " malformed entries skipped";
+    std::cout << " in " << secs << "s";
+    if ( secs > 0 )
+        std::cout << " (" << uint64_t( cnt / secs ) << " positions/sec)";
+    std::cout << " using " << pool.size() << " threads" << std::endl;
+
+    if ( check ) {
+        std::unique_ptr<Source> again = make_source( in_fmt, bytes, identity );
+        again->quiet();
+        uint64_t bad = ( again->open(in) ) ? verify( *again, out_fmt, out, bytes, pool ) : 1;
+        if ( bad ) {
+            std::cout << "verify: FAIL, " << bad << " mismatches" << std::endl;
+            return 1;
+        }
+        std::cout << "verify: PASS" << std::endl;
+    }
+    return 0;
+}
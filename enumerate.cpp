@@ -0,0 +1,65 @@
+// enumerate - breadth-first enumeration of every position reachable
+// from a root, one ply level at a time
+//
+// usage: enumerate [-d depth] [-t threads] [-mem mb] [-dir path] [-full] [-first] [fen]
+//
+// Each level is written to dir as level-NN.pks, a sorted PackStore of
+// the distinct positions at that ply. -t sets the worker threads (0, the
+// default, for one per hardware thread), -mem the sort buffer for each
+// level. Positions are compared ignoring clocks and unusable en passant
+// squares unless -full is given. -first keeps each position only at the
+// first ply it is reached.
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "garth.h"
+#include "enumerate.h"
+
+int main(int argc, char **argv) {
+    EnumerateOptions opt;
+    int              threads(0);
+    std::string      fen(Board::init_pos_fen);
+
+    for ( int idx(1); idx < argc; ++idx ) {
+        if ( !std::strcmp( argv[idx], "-d" ) && idx + 1 < argc ) {
+            opt.depth = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-t" ) && idx + 1 < argc ) {
+            threads = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-mem" ) && idx + 1 < argc ) {
+            opt.ram_mb = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-dir" ) && idx + 1 < argc ) {
+            opt.dir = argv[++idx];
+        } else if ( !std::strcmp( argv[idx], "-full" ) ) {
+            opt.identity = false;
+        } else if ( !std::strcmp( argv[idx], "-first" ) ) {
+            opt.first_seen = true;
+        } else if ( argv[idx][0] == '-' ) {
+            std::cerr << "usage: enumerate [-d depth] [-t threads] [-mem mb] [-dir path] [-full] [-first] [fen]" << std::endl;
+            return 2;
+        } else {
+            fen = argv[idx];
+        }
+    }
+
+    ThreadPool pool( threads );
+    std::cout << "using " << pool.size() << " threads" << std::endl;
+
+    Board b(fen);
+    bool ok = enumerate_positions( b, pool, opt, []( const EnumerateLevel& lvl ) {
+        std::cout << "ply " << lvl.ply
+                  << ": " << lvl.unique << " positions"
+                  << " (" << lvl.children << " children of " << lvl.parents << ")"
+                  << " in " << lvl.secs << "s";
+        if ( lvl.seen )
+            std::cout << " (" << lvl.seen << " seen before)";
+        if ( lvl.secs > 0 && lvl.children )
+            std::cout << " (" << uint64_t( lvl.children / lvl.secs ) << " children/sec)";
+        std::cout << " -> " << lvl.path << std::endl;
+    } );
+    if ( !ok ) {
+        std::cerr << "enumerate: failed writing or reading a level in " << opt.dir << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -6,4 +6,15 @@
 #include "piece.h"
 #include "move.h"
 #include "board.h"
+#include "perft.h"
+#include "treewalk.h"
+#include "packstore.h"
+#include "packsort.h"
+#include "enumerate.h"
+#include "packset.h"
+#include "packfilter.h"
+#include "epd.h"
+#include "deltastore.h"
+#include "gamecodec.h"
+#include "pgn.h"
 #include "util.h"
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "bitboard.h"
+
+// Sliding piece attack tables
+//
+// Rook and bishop attacks are looked up in precomputed tables indexed by
+// the occupancy of the squares the slider can see. The index is formed
+// either with a magic multiply, or - in a build for BMI2 (-mbmi2, which
+// the Makefile adds when the build machine has it) - with a single PEXT
+// of the occupancy against the square's mask. The choice is made at
+// compile time, so a lookup is one inlined instruction sequence with no
+// test or call; the two methods fill the tables differently, so the whole
+// program must be built the same way, which the link checks.
+//
+// Tables are built by a static initializer in attacks.cpp, so they are
+// ready before main() runs. The knight, king and pawn tables further down
+// are constant-initialized and need no setup at all.
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#define ATTACKS_USE_PEXT 1
+#else
+#define ATTACKS_USE_PEXT 0
+#endif
+
+struct Magic {
+    Bitboard  mask;     // relevant occupancy (edges excluded)
+    Bitboard  magic;    // magic multiplier (unused with PEXT)
+    Bitboard *attacks;  // start of this square's slice of the table
+    unsigned  shift;    // 64 - popcount(mask)
+
+    unsigned index( Bitboard occ ) const;
+};
+
+extern Magic rook_magics[64];
+extern Magic bishop_magics[64];
+
+// Only the library built the same way defines the name used here, so
+// mixing PEXT and magic objects fails to link rather than misreading the
+// tables.
+#if ATTACKS_USE_PEXT
+extern const bool attacks_built_for_pext;
+__attribute__((used)) static const bool *const attacks_build_check = &attacks_built_for_pext;
+#else
+extern const bool attacks_built_for_magic;
+__attribute__((used)) static const bool *const attacks_build_check = &attacks_built_for_magic;
+#endif
+
+inline unsigned Magic::index( Bitboard occ ) const {
+#if ATTACKS_USE_PEXT
+    return unsigned( _pext_u64( occ, mask ) );
+#else
+    return unsigned( ( ( occ & mask ) * magic ) >> shift );
+#endif
+}
+
+inline Bitboard rook_attacks( int idx, Bitboard occ ) {
+    const Magic& m = rook_magics[idx];
+    return m.attacks[ m.index(occ) ];
+}
+
+inline Bitboard bishop_attacks( int idx, Bitboard occ ) {
+    const Magic& m = bishop_magics[idx];
+    return m.attacks[ m.index(occ) ];
+}
+
+inline Bitboard queen_attacks( int idx, Bitboard occ ) {
+    return rook_attacks( idx, occ ) | bishop_attacks( idx, occ );
+}
+
+// Set-wise attacks for the non-sliding pieces - every square attacked by
+// any of the pieces in bb.
+constexpr Bitboard knight_attacks_bb( Bitboard bb ) {
+    Bitboard l1 = ( bb >> 1 ) & ~BB_FILE_H;
+    Bitboard l2 = ( bb >> 2 ) & ~( BB_FILE_G | BB_FILE_H );
+    Bitboard r1 = ( bb << 1 ) & ~BB_FILE_A;
+    Bitboard r2 = ( bb << 2 ) & ~( BB_FILE_A | BB_FILE_B );
+    Bitboard h1 = l1 | r1;
+    Bitboard h2 = l2 | r2;
+    return ( h1 << 16 ) | ( h1 >> 16 ) | ( h2 << 8 ) | ( h2 >> 8 );
+}
+
+constexpr Bitboard king_attacks_bb( Bitboard bb ) {
+    Bitboard row = bb | ( ( bb >> 1 ) & ~BB_FILE_H ) | ( ( bb << 1 ) & ~BB_FILE_A );
+    return ( row | ( row << 8 ) | ( row >> 8 ) ) & ~bb;
+}
+
+constexpr Bitboard pawn_attacks_bb( Bitboard bb, Side s ) {
+    return ( IS_BLACK(s) ) ? ( ( bb & ~BB_FILE_A ) >> 9 ) | ( ( bb & ~BB_FILE_H ) >> 7 )
+                           : ( ( bb & ~BB_FILE_A ) << 7 ) | ( ( bb & ~BB_FILE_H ) << 9 );
+}
+
+// Per-square attacks for the non-sliding pieces, generated at compile
+// time from the set-wise functions above. Pawn attacks are indexed by
+// the side of the attacking pawn.
+struct LeaperAttacks {
+    Bitboard knight[64];
+    Bitboard king[64];
+    Bitboard pawn[2][64];
+};
+
+extern const LeaperAttacks leaper_attacks;
+
+inline Bitboard knight_attacks( int idx )        { return leaper_attacks.knight[idx]; }
+inline Bitboard king_attacks( int idx )          { return leaper_attacks.king[idx]; }
+inline Bitboard pawn_attacks( int idx, Side s )  { return leaper_attacks.pawn[s][idx]; }
+
+// the squares strictly between a and b if they share a rank, file or
+// diagonal, otherwise BB_EMPTY
+inline Bitboard between_bb( int a, int b ) {
+    if ( rook_attacks( a, BB_EMPTY ) & bb_bit(b) )
+        return rook_attacks( a, bb_bit(b) ) & rook_attacks( b, bb_bit(a) );
+    if ( bishop_attacks( a, BB_EMPTY ) & bb_bit(b) )
+        return bishop_attacks( a, bb_bit(b) ) & bishop_attacks( b, bb_bit(a) );
+    return BB_EMPTY;
+}
+
+// attacks for any sliding piece type, or BB_EMPTY for non-sliders
+Bitboard slider_attacks( PieceType pt, int idx, Bitboard occ );
+
+// build the tables. This is done automatically at startup.
+void init_attacks();
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "constants.h"
+#include "square.h"
+
+// A Bitboard is a 64-bit set of squares. Bit n corresponds to the square
+// whose RnF value is n, so a1 (R1,Fa) is bit 0 and h8 (R8,Fh) is bit 63.
+typedef uint64_t Bitboard;
+
+#define BB_EMPTY 0ULL
+#define BB_FULL  (~0ULL)
+
+#define BB_RANK_1 0x00000000000000ffULL
+#define BB_RANK_8 0xff00000000000000ULL
+#define BB_FILE_A 0x0101010101010101ULL
+#define BB_FILE_B 0x0202020202020202ULL
+#define BB_FILE_G 0x4040404040404040ULL
+#define BB_FILE_H 0x8080808080808080ULL
+
+// square index used when there is no square (e.g. no en passant.)
+// This is also what Square::UNBOUNDED packs to in 7 bits.
+#define SQ_NONE 0x7f
+
+inline Bitboard bb_bit( int idx )           { return 1ULL << idx; }
+inline Bitboard bb_bit( const Square& squ ) { return 1ULL << squ.rnf(); }
+
+inline int  bb_count( Bitboard bb ) { return __builtin_popcountll(bb); }
+inline int  bb_lsb( Bitboard bb )   { return __builtin_ctzll(bb); }
+inline bool bb_test( Bitboard bb, int idx ) { return ( bb >> idx ) & 1ULL; }
+
+// return the index of the lowest set square, and remove it from bb.
+inline int bb_pop( Bitboard& bb ) {
+    int idx = __builtin_ctzll(bb);
+    bb &= bb - 1;
+    return idx;
+}
+
+inline Rank sq_rank( int idx ) { return Rank( idx >> 3 ); }
+inline File sq_file( int idx ) { return File( idx & 0x07 ); }
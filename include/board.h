@@ -2,14 +2,48 @@
 
 class Board; // forward
 
+#include <string_view>
+
+#include "bitboard.h"
 #include "constants.h"
 #include "piece.h"
 #include "util.h"
 
+// The state make_move() cannot recover from the move itself, saved so
+// that unmake_move() can put the board back exactly as it was.
+struct MoveUndo {
+    uint8_t moved;                  // Piece::byte() of the piece that moved
+    uint8_t captured;               // Piece::byte() of the captured piece, 0 if none
+    bool    castle_white_queenside;
+    bool    castle_white_kingside;
+    bool    castle_black_queenside;
+    bool    castle_black_kingside;
+    Square  en_passant;
+    short   half_move_clock;
+    short   full_move_cnt;
+    uint64_t key;
+};
+
+// buffer sizes for Board::fen_to() and Board::diagram_to(), with room
+// for the terminating NUL. The longest FEN has a full placement field
+// (8 pieces a rank), KQkq, an en passant square and two 6-char clocks.
+#define FEN_MAX     ( 71 + 2 + 5 + 3 + 7 + 7 + 1 )
+#define DIAGRAM_MAX ( 8 * 20 + 19 + 1 )
+
+// where and why Board::parse_fen() rejected its input
+struct FenError {
+    size_t      pos;    // offset of the offending character
+    const char *msg;
+};
+
 class Board {
 private:
-    PieceMap    _pm;
-    PiecePtr    _kings[2];
+    // The board core is kept as occupancy bitboards - one per piece type
+    // and one per side - along with a mailbox holding the Piece::byte()
+    // of every square (0 for an empty square) for fast type lookup.
+    Bitboard    _bb_type[8];
+    Bitboard    _bb_side[2];
+    uint8_t     _mailbox[64];
 
     Side        _on_move;
     bool        _castle_white_queenside;
@@ -19,21 +53,38 @@ private:
     Square      _en_passant;
     short       _half_move_clock;
     short       _full_move_cnt;
+    uint64_t    _key;           // Zobrist key, kept up to date incrementally
 public:
     Board(bool initial_position = true);
     Board(const char *fen);
     Board(std::string fen);
     Board(BoardPacked pack);
-    int piece_cnt();
+    int piece_cnt() const;
     PiecePtr at( Rank r, File f ) const;
     PiecePtr at( Square squ ) const;
     bool is_empty(Rank r, File f) const;
     bool is_empty(Square squ) const;
+    // read-only queries answered straight from the mailbox, without
+    // building a Piece. Off-board squares read as empty.
+    uint8_t   byte_at( Square squ ) const;
+    PieceType type_at( Square squ ) const;
+    Side      side_at( Square squ ) const;     // SIDE_NONE if empty
+    char      glyph_at( Square squ ) const;
     void clear_square(Square squ);
     PiecePtr set( Rank r, File f, PieceType pt, Side s );
     PiecePtr set( RnF rnf, PieceType pt, Side s );
     PiecePtr set( Square squ, PieceType pt, Side s );
     void place( PiecePtr p, Square squ);
+    void clear();
+
+    Bitboard occupied() const;
+    Bitboard side_bb( Side s ) const;
+    Bitboard type_bb( PieceType pt ) const;
+    Bitboard pawns_bb( Side s ) const;
+    Square   king_square( Side s ) const;
+
+    uint64_t key() const;
+    uint64_t compute_key() const;
     Side get_on_move() const;
     void set_on_move(Side s);
     void toggle_on_move();
@@ -65,16 +116,24 @@ public:
     PieceList get_side_pieces( Side s ) const;
     void set_initial_position();
     MoveList& get_moves(MoveList& moves) const;
+    MoveArray& get_moves(MoveArray& moves) const;
+    MoveArray& get_legal_moves(MoveArray& moves) const;
     void get_pawn_moves( PiecePtr ptr, MoveList& moves) const;
     void apply_move(Move& mov, Board& cpy);
+    void make_move(MovePacked mov, MoveUndo& undo);
+    void unmake_move(MovePacked mov, const MoveUndo& undo);
     void move_piece(PiecePtr ptr, Square dst);
     std::string diagram() const;
+    char *diagram_to( char *buf ) const;
     void gather_moves( PiecePtr pp, DirList dirs, MoveList& moves, bool isPawnCapture = false) const;
     MovePtr check_square(PiecePtr pp, Square trg, bool isPawnCapture = false) const;
     void check_castle( PiecePtr ptr, MoveList& moves ) const;
 
     short test_for_attack(PiecePtr trg, Side s = SIDE_NONE) const;
     short test_for_check(Side s) const;
+    Bitboard attackers_to( int idx, Side by ) const;
+    Bitboard attackers_to( int idx, Side by, Bitboard occ ) const;
+    bool can_capture_en_passant() const;
 
     enum SeekResultCode {
         SEEKRC_NONE,            
@@ -90,7 +149,7 @@ public:
         Square         trg;   // where we're going
         Dir            dir;   // direction we sought
         short          range; // max number of steps
-        PiecePtr       enc;   // piece we found
+        uint8_t        enc;   // piece byte we found, 0 if none
         SquareList     path;  // steps we took        
         SeekResultCode rc; 
     };
@@ -98,11 +157,57 @@ public:
     SeekResult seek( PiecePtr src, Dir dir, PiecePtr trg, short range = 0 ) const;
     SeekResult seek( PiecePtr src, Dir dir, Square dst, short range = 0 ) const;
 
+private:
+    void put_byte( int idx, uint8_t by );
+    void remove_byte( int idx );
+    PiecePtr piece_at( int idx ) const;
+    void move_byte( int org, int dst );
+    void update_castle_rights( int idx );
+    void push_moves( int org, Bitboard trgs, MoveArray& moves ) const;
+    void gen_pawn_moves( int org, Side s, Bitboard allowed, bool legal, MoveArray& moves ) const;
+    void gen_castle_moves( int org, Side s, MoveArray& moves ) const;
+    bool en_passant_is_safe( int org, int epos, int vict ) const;
+    short count_attacks( int dst, Side side ) const;
+    bool castle_path_clear( Square king, Dir dir, Square rook, Side s ) const;
+    MovePtr check_square( Square org, Side side, Square dst, bool isPawnCapture ) const;
+
+public:
+
     void from_fen(const std::string& fen);
-    std::string fen();
+    bool parse_fen(std::string_view fen, FenError *err = nullptr);
+    std::string fen() const;
+    char *fen_to(char *buf) const;
 
     BoardPacked pack() const;
     void        unpack(BoardPacked pack);
+
+    // Position identity - what makes two positions the same for
+    // transposition purposes. Clocks are left out, and the en passant
+    // square only counts when a capture there is actually legal, so the
+    // same position reached by different move orders packs and hashes
+    // the same.
+    BoardPacked pack_identity() const;
+    uint64_t    identity_key() const;
+
+    // pack or unpack cnt positions at once, using BMI2/AVX2 when the CPU
+    // has them. Results are identical to pack()/unpack() on each one.
+    static void pack_many( const Board *boards, BoardPacked *packs, size_t cnt );
+    static void unpack_many( const BoardPacked *packs, Board *boards, size_t cnt );
+
+    // Symmetry (see BoardTransform.) transformed() applies t - applying
+    // it again restores the original. pack_canonical() packs the smallest
+    // of the equivalent positions, and reports the transform that gave it,
+    // so all the symmetric variants of a position share one record.
+    Board       transformed( BoardTransform t ) const;
+    BoardPacked pack_canonical( BoardTransform *used = nullptr ) const;
+    static BoardPacked canonical( const BoardPacked& pack, BoardTransform *used = nullptr );
+
+private:
+    uint64_t    pack_info() const;
+    void        unpack_info( uint64_t info );
+    BoardPacked pack_fast() const;
+    void        unpack_fast( const BoardPacked& pack );
+
 public:
     static PiecePtr EMPTY;
     static const char *init_pos_fen;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstring>
 #include <map>
 #include <memory>
 #include <utility>
@@ -14,7 +15,7 @@ enum Side { SIDE_WHITE=0, SIDE_BLACK, SIDE_NONE };
 enum Rank : uint8_t { R1=0, R2, R3, R4, R5, R6, R7, R8 };
 enum File : uint8_t { Fa=0, Fb, Fc, Fd, Fe, Ff, Fg, Fh };
 
-#define RNF(r,f) ((r<<3)|f)
+#define RNF(r,f) (((r)<<3)|(f))
 
 // convenience references so that squares can be refered to by their
 // canonical names.
@@ -134,6 +135,8 @@ struct Move; // forward
 typedef std::shared_ptr<Move> MovePtr;
 typedef std::vector<MovePtr>  MoveList;
 
+class MoveArray; // forward
+
 class MoveRule; // forward
 
 typedef std::shared_ptr<MoveRule> MoveRulePtr;
@@ -192,9 +195,34 @@ union BoardPacked {
     BoardPacked() {
         f.gi = f.pop = f.lo = f.hi = 0;
     }
+    bool operator==(const BoardPacked& rhs) const { return std::memcmp( b, rhs.b, sizeof(b) ) == 0; }
+    bool operator!=(const BoardPacked& rhs) const { return !( *this == rhs ); }
+    // Byte order, so any two packs compare the same way on every machine.
+    // Done a word at a time - byte-swapped words compare like memcmp().
+    bool operator<(const BoardPacked& rhs) const {
+        for ( int w(0); w < 4; ++w ) {
+            uint64_t l, r;
+            std::memcpy( &l, b + 8 * w, 8 );
+            std::memcpy( &r, rhs.b + 8 * w, 8 );
+            if ( l != r )
+                return __builtin_bswap64(l) < __builtin_bswap64(r);
+        }
+        return false;
+    }
     friend std::ostream& operator<<(std::ostream& os, const BoardPacked& p);
 };
 
+// The symmetries of a position. Mirroring swaps the a and h files, which
+// is only an equivalent position when neither side can castle. Flipping
+// swaps the colors along with ranks 1 and 8, the side on-move and the
+// castling rights. Each is its own inverse, and they combine freely.
+enum BoardTransform : uint8_t {
+    BT_IDENTITY    = 0,
+    BT_MIRROR      = 1,
+    BT_FLIP        = 2,
+    BT_MIRROR_FLIP = 3
+};
+
 union MovePacked {
     uint32_t i;
     struct {
@@ -207,6 +235,14 @@ union MovePacked {
     MovePacked() 
     : i(0) 
     {}
+    MovePacked(MoveAction ma, uint8_t org, uint8_t dst)
+    : i(0)
+    {
+        f.action = ma;
+        f.source = org;
+        f.target = dst;
+    }
+    bool operator==(const MovePacked& rhs) const { return i == rhs.i; }
     friend std::ostream& operator<<(std::ostream& os, const MovePacked& p);
 };
 #pragma pack()
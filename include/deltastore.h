@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "constants.h"
+
+// DeltaStore - a file of positions, most of them stored as a move from
+// an earlier position in the same file rather than in full.
+//
+// Every record is one 8-byte entry. A delta entry holds the id (index)
+// of its parent record and the move that was made from it, the move cut
+// to the 16 bits make_move() needs - action, source and target. A
+// snapshot entry instead points to a full BoardPacked kept after the
+// entries. A position is rebuilt by following parents back to a
+// snapshot, unpacking that, and making the moves forward again.
+//
+// The writer stores a snapshot in place of a delta whenever the delta
+// would make a chain of more than max_chain moves, so no rebuild makes
+// more than max_chain moves. A store of children thus costs 8 bytes a
+// record, plus a 32-byte snapshot for one record in max_chain + 1 at
+// worst, against 32 bytes for every record stored in full.
+//
+// The file is a one page header, the entries from the next page, then
+// the snapshots from the page after the entries end.
+
+#define DELTASTORE_MAGIC     "GARTHDLT"
+#define DELTASTORE_VERSION   1
+#define DELTASTORE_PAGE      4096
+#define DELTASTORE_CHAIN     16     // default max_chain
+#define DELTASTORE_CHAIN_MAX 64
+
+#pragma pack(1)
+struct DeltaStoreHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t max_chain;         // longest run of moves from a snapshot
+    uint64_t record_cnt;
+    uint64_t record_off;        // file offset of the first entry
+    uint64_t snapshot_cnt;
+    uint64_t snapshot_off;      // file offset of the first snapshot
+    uint8_t  unused[16];
+};
+#pragma pack()
+
+class DeltaStore {
+public:
+    DeltaStore();
+    ~DeltaStore();
+    DeltaStore(const DeltaStore&) = delete;
+    DeltaStore& operator=(const DeltaStore&) = delete;
+
+    bool open( const std::string& path );
+    void close();
+    bool is_open() const;
+
+    uint64_t size() const;
+    uint64_t snapshot_cnt() const;
+    int      max_chain() const;
+
+    bool       is_snapshot( uint64_t id ) const;
+    // for a delta record, its parent and the move made from it
+    uint64_t   parent( uint64_t id ) const;
+    MovePacked move( uint64_t id ) const;
+
+    // rebuild record id into b. False if id is out of range or the store
+    // is corrupt (a chain too long, or running forward).
+    bool rebuild( uint64_t id, Board& b ) const;
+
+private:
+    int                 _fd;
+    uint8_t            *_map;
+    size_t              _map_size;
+    uint64_t            _cnt;
+    const uint64_t     *_entries;
+    uint64_t            _snap_cnt;
+    const BoardPacked  *_snaps;
+    int                 _max_chain;
+};
+
+// DeltaStoreWriter - build a store a record at a time. Entries are
+// streamed to the file, snapshots to an unlinked temporary beside it
+// until close(). The chain length of every record (a byte each) is
+// kept in memory.
+class DeltaStoreWriter {
+public:
+    DeltaStoreWriter();
+    ~DeltaStoreWriter();
+    DeltaStoreWriter(const DeltaStoreWriter&) = delete;
+    DeltaStoreWriter& operator=(const DeltaStoreWriter&) = delete;
+
+    // start a store at path, first closing (and so finishing) any store
+    // still open
+    bool open( const std::string& path, int max_chain = DELTASTORE_CHAIN );
+
+    // Add a position, returning its id, or -1 on a write error or an
+    // unknown parent. child is the board after mov was made from parent,
+    // stored in full if the chain would get too long.
+    int64_t add( const BoardPacked& rec );
+    int64_t add( uint64_t parent, MovePacked mov, const Board& child );
+
+    // write the snapshots and header. The store is not valid until this
+    // returns true.
+    bool     close();
+    uint64_t count() const;
+    uint64_t snapshot_cnt() const;
+
+private:
+    bool flush();
+
+    int                   _fd;
+    int                   _snap_fd;
+    int                   _max_chain;
+    bool                  _ok;
+    uint64_t              _snap_cnt;
+    std::vector<uint8_t>  _chain;       // moves back to a snapshot, per record
+    std::vector<uint64_t> _buf;
+    BoardPackedList       _snap_buf;
+};
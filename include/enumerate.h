@@ -0,0 +1,68 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "board.h"
+#include "threadpool.h"
+
+// Breadth-first position enumeration
+//
+// Starting from a root position, every position reachable in 1, 2, ...
+// plies is generated one level at a time. Each level is written to disk
+// as a sorted, duplicate-free PackStore, which is the input for the
+// next level:
+// - the parent store is mapped and cut into chunks, one task each on a
+//   ThreadPool
+// - a task unpacks its parents, makes every legal move, and packs the
+//   children
+// - the children go to a PackSorter, which spills to disk when its RAM
+//   budget fills
+// - the merged, deduplicated result becomes the next level's store
+// So no level ever has to fit in memory.
+//
+// By default children are packed with pack_identity(), so transpositions
+// within a level are merged. Duplicates are only removed within a level
+// - a position reachable at several depths appears at each of them -
+// unless first_seen is set. Then a child already stored at an earlier
+// ply (of the same parity, as the side to move must match) is dropped,
+// so each position is kept only at the first ply it is reached. Each
+// earlier level is pre-screened with a PackFilter, so most children -
+// the new ones - are passed without searching any store.
+
+struct EnumerateOptions {
+    std::string dir;            // where level files (and sort runs) go
+    int         depth;          // last ply to generate
+    size_t      ram_mb;         // sort buffer budget per level
+    bool        identity;       // pack_identity() rather than pack()
+    size_t      chunk;          // parents per task
+    bool        first_seen;     // drop positions found at an earlier ply
+    double      filter_fp;      // false positive rate of the pre-screen
+
+    EnumerateOptions()
+    : dir("."), depth(4), ram_mb(256), identity(true), chunk(4096)
+    , first_seen(false), filter_fp(0.01)
+    {}
+};
+
+struct EnumerateLevel {
+    int         ply;
+    uint64_t    parents;        // positions at the previous ply
+    uint64_t    children;       // legal moves made from them
+    uint64_t    seen;           // children dropped as found at an earlier ply
+    uint64_t    unique;         // distinct positions at this ply
+    double      secs;
+    std::string path;           // store holding this level
+};
+
+typedef std::function<void(const EnumerateLevel& level)> LevelReport;
+
+// the store file for ply in dir
+std::string enumerate_level_path( const std::string& dir, int ply );
+
+// Enumerate from root to opt.depth, calling report (if given) as each
+// level is finished. Level 0 is the root alone. Returns false if a
+// level could not be written or read back.
+bool enumerate_positions( const Board& root, ThreadPool& pool,
+                          const EnumerateOptions& opt,
+                          const LevelReport& report = nullptr );
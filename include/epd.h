@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "threadpool.h"
+
+// EpdFile - bulk loading of FEN or EPD files, one position per line.
+//
+// The file is mapped rather than read, and cut into chunks at line
+// boundaries that are parsed in parallel on a ThreadPool with
+// Board::parse_fen(), so no line is ever copied into a string. Blank
+// lines and lines starting with '#' are skipped. A malformed line is
+// left out of the results and, if asked for, reported with its line
+// and column; reporting costs nothing on lines that parse.
+
+#define EPD_CHUNK ( 1 << 20 )   // bytes of file per task, and per write
+
+struct EpdError {
+    uint64_t    line;           // 1-based
+    size_t      col;            // 1-based
+    const char *msg;
+};
+typedef std::vector<EpdError> EpdErrorList;
+
+class EpdFile {
+public:
+    EpdFile();
+    ~EpdFile();
+    EpdFile(const EpdFile&) = delete;
+    EpdFile& operator=(const EpdFile&) = delete;
+
+    bool   open( const std::string& path );
+    void   close();
+    bool   is_open() const;
+    size_t bytes() const;
+
+    // Parse every line, replacing the contents of the output with the
+    // positions in file order. Errors (if errs is given) are likewise
+    // in file order. Returns the number of positions loaded.
+    uint64_t load( ThreadPool& pool, std::vector<Board>& boards, EpdErrorList *errs = nullptr ) const;
+    // as above, packed with pack() - or pack_identity() if identity
+    uint64_t load( ThreadPool& pool, BoardPackedList& packs, EpdErrorList *errs = nullptr,
+                   bool identity = false ) const;
+
+    // Load the file a stretch of about bytes (in whole lines) at a time,
+    // for files too big to hold at once. Each call replaces packs (and
+    // errs) with the next stretch's positions. Returns false, loading
+    // nothing, once the file is used up. rewind() starts it over.
+    bool load_next( ThreadPool& pool, BoardPackedList& packs, size_t bytes,
+                    EpdErrorList *errs = nullptr, bool identity = false );
+    void rewind();
+
+private:
+    struct Chunk {
+        const char  *beg;
+        const char  *end;
+        uint64_t     line;      // line number of beg
+        uint64_t     first;     // output index of the chunk's first position
+        uint64_t     cnt;       // positions in it (candidate lines, then loaded)
+        EpdErrorList errs;
+    };
+
+    std::vector<Chunk> chunks( ThreadPool& pool, const char *beg, const char *end, uint64_t line ) const;
+    template <class T, class Parse>
+    uint64_t load_into( ThreadPool& pool, std::vector<T>& out, const T& blank, EpdErrorList *errs,
+                        const char *beg, const char *end, uint64_t line, Parse parse ) const;
+
+    int         _fd;
+    const char *_map;
+    size_t      _size;
+    const char *_next;          // where load_next() carries on
+    uint64_t    _next_line;
+};
+
+// Write the FEN of each of recs[0..cnt) to fd, one per line. Records are
+// unpacked in batches and their FENs gathered into EPD_CHUNK sized
+// writes. Returns false if a write fails.
+bool write_fens( int fd, const BoardPacked *recs, size_t cnt );
+// as above, with the FENs made on pool in parallel and written in order
+bool write_fens( ThreadPool& pool, int fd, const BoardPacked *recs, size_t cnt );
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+#include "move.h"
+
+// Game record codec
+//
+// A game is stored as, for each ply, the index of the move played in the
+// list get_legal_moves() produces for the position - an order fixed by
+// the generator, so the decoder, replaying the game, builds the same
+// list. The indexes are range coded with an adaptive model of how often
+// each index is played, restricted at each ply to the indexes that are
+// legal there, so a forced move costs nothing and a typical ply well
+// under a byte.
+//
+// A record is a varint payload length, a varint ply count, then the
+// coded indexes. The model adapts as it codes, so the encoder and the
+// decoder must give each record a model in the same state - a fresh one
+// per record for random access, or one carried through a block of
+// records for tighter coding.
+
+#define GAMECODEC_SYMBOLS 256   // more than the most legal moves of any reachable position
+
+class GameModel {
+public:
+    GameModel();
+    void reset();
+
+private:
+    friend class GameEncoder;
+    friend class GameDecoder;
+
+    // frequency total of the indexes below n
+    uint32_t total( int n ) const;
+    void     update( int sym );
+
+    uint16_t _freq[GAMECODEC_SYMBOLS];
+    uint32_t _total;
+};
+
+class GameEncoder {
+public:
+    GameEncoder( GameModel& model );
+
+    // Append the record for moves played from root to out. False, with
+    // out and the model both unchanged, if a move is not legal where it
+    // is played, or is played where there are more than
+    // GAMECODEC_SYMBOLS legal moves.
+    bool encode( const Board& root, const MovePacked *moves, size_t cnt, std::vector<uint8_t>& out );
+
+private:
+    GameModel& _model;
+};
+
+// GameDecoder - replays a record a ply at a time
+class GameDecoder {
+public:
+    GameDecoder( GameModel& model );
+
+    // Start on the record at data, playing from root. Returns the length
+    // of the whole record (where the next one starts), or 0 if it is
+    // cut short.
+    size_t start( const uint8_t *data, size_t len, const Board& root );
+    // Decode the next ply and make it on board(). False once every ply
+    // is played, or if the record does not fit the position.
+    bool   next( MovePacked& mov );
+
+    const Board& board() const;
+    size_t       plies() const;     // in the record
+    size_t       played() const;    // so far
+
+private:
+    uint8_t in();
+
+    GameModel&     _model;
+    Board          _board;
+    const uint8_t *_p;
+    const uint8_t *_end;
+    size_t         _plies;
+    size_t         _played;
+    uint32_t       _low;
+    uint32_t       _range;
+    uint32_t       _code;
+};
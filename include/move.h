@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <memory>
 #include <vector>
 
@@ -16,6 +17,7 @@ struct Move {
     Move(MoveAction ma, MoveResult mr, Square org, Square dst );
     Move(MovePacked pack);
     static MovePtr create(MoveAction ma, MoveResult mr, Square org, Square dst );
+    static MovePtr create(MovePacked pack);
 
     MovePacked pack() const;
     void unpack(MovePacked pack);
@@ -23,3 +25,38 @@ struct Move {
     friend std::ostream& operator<<(std::ostream& os, const Move& mv);
 };
 
+
+// MoveArray is a fixed capacity list of packed moves meant to live on the
+// stack, so generating moves does not touch the heap. The capacity covers
+// the most pseudo-legal moves any material parse_fen() accepts could give
+// one side: nine queens (27 moves each), two rooks (14), two bishops (13),
+// two knights (8) and a king (8, plus 2 castles) come to 323. A pawn, at
+// 12 moves with promotions, never beats the queen it could become.
+class MoveArray {
+public:
+    static const int CAPACITY = 324;
+
+private:
+    // wrapped in a union so the entries are not zeroed on construction
+    union {
+        MovePacked _moves[CAPACITY];
+    };
+    int _cnt;
+
+public:
+    MoveArray() : _cnt(0) {}
+
+    inline void push_back( MovePacked mv ) { assert( _cnt < CAPACITY ); _moves[_cnt++] = mv; }
+    inline void clear()                    { _cnt = 0; }
+    inline int  size()  const              { return _cnt; }
+    inline bool empty() const              { return _cnt == 0; }
+
+    inline MovePacked&       operator[]( int idx )       { return _moves[idx]; }
+    inline const MovePacked& operator[]( int idx ) const { return _moves[idx]; }
+    inline MovePacked&       back()                      { return _moves[_cnt - 1]; }
+
+    inline MovePacked*       begin()       { return _moves; }
+    inline MovePacked*       end()         { return _moves + _cnt; }
+    inline const MovePacked* begin() const { return _moves; }
+    inline const MovePacked* end()   const { return _moves + _cnt; }
+};
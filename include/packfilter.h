@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "constants.h"
+
+// PackFilter - a blocked Bloom filter over BoardPacked keys, answering
+// "definitely not seen" or "maybe seen" far more cheaply than an exact
+// set or a disk lookup.
+//
+// Each key hashes to a single 64-byte, cache-line aligned block and sets
+// k bits within it, so an insert or a query costs one cache miss however
+// large the filter. Bits are set with atomic fetch_or, so any number of
+// threads may insert and query at once. A filter never gives a false
+// "not seen". Confining each key to one block costs a little accuracy
+// compared with a plain Bloom filter, so it is given about 10% more bits
+// than the textbook size for the requested false positive rate.
+class PackFilter {
+public:
+    // sized for expected keys at a false positive rate of fp_rate
+    PackFilter( uint64_t expected, double fp_rate = 0.01 );
+
+    // add key, returning true if it was definitely not present before
+    bool   insert( const BoardPacked& key );
+    bool   maybe_contains( const BoardPacked& key ) const;
+    void   clear();
+    size_t size_bytes() const;
+    int    hashes() const;
+
+private:
+    struct alignas(64) Block {
+        std::atomic<uint64_t> w[8];
+    };
+
+    const Block& block_for( uint64_t h ) const;
+
+    uint64_t                 _cnt;      // blocks
+    int                      _k;        // bits set per key
+    std::unique_ptr<Block[]> _blocks;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "constants.h"
+
+// 64-bit hash of all 256 bits of a BoardPacked. Each word gets its own
+// odd multiplier and rotation, so swapped or shifted words hash apart,
+// and a final avalanche spreads the result over every bit.
+inline uint64_t pack_hash( const BoardPacked& p ) {
+    auto rotl = []( uint64_t x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); };
+    uint64_t h = ( p.f.gi * 0x9e3779b97f4a7c15ULL )
+               ^ rotl( p.f.pop * 0xc2b2ae3d27d4eb4fULL, 17 )
+               ^ rotl( p.f.lo  * 0x165667b19e3779f9ULL, 31 )
+               ^ rotl( p.f.hi  * 0xd6e8feb86659fd93ULL, 47 );
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+// PackSet - a concurrent set of BoardPacked, for deduplication.
+//
+// Open addressing with linear probing over two parallel arrays: the keys,
+// and a 32-bit tag per slot holding a fingerprint of the key's hash. A
+// slot is claimed by CAS on its tag from empty to "pending", the key is
+// written, and the tag is then set to "ready". Readers skip slots whose
+// fingerprint differs without touching the key, and wait out the
+// (few-instruction) pending window only when the fingerprint matches. No
+// locks are taken on the way, and the overhead is 4 bytes a slot.
+//
+// The set grows by itself, while other threads keep using it. When the
+// table passes 3/4 full, or a probe runs too long, a table twice the size
+// is linked behind it, and every thread that comes by helps move the old
+// table over a chunk of slots at a time. Moving a slot freezes it: an
+// empty slot can no longer be claimed, and a key stays readable where it
+// was. A search that meets a frozen empty slot (or runs out of probes)
+// carries on in the next table. A key can only be claimed at the first
+// open slot of its run, so one not found before a frozen slot is not in
+// the old table at all, and inserting it in the new one can't make a
+// duplicate. Once every chunk is moved, the new table becomes current.
+// Old tables are kept, since other threads may still be reading them,
+// until clear() or the set is destroyed - together less than the current
+// table again.
+class PackSet {
+public:
+    enum Insert {
+        INSERTED,   // key was not present, and now is
+        PRESENT     // key was already in the set
+    };
+
+    // capacity is rounded up to a power of two
+    PackSet( uint64_t capacity = 1 << 20 );
+    ~PackSet();
+    PackSet(const PackSet&) = delete;
+    PackSet& operator=(const PackSet&) = delete;
+
+    Insert   insert( const BoardPacked& key );
+    bool     contains( const BoardPacked& key ) const;
+    uint64_t size() const;
+    uint64_t capacity() const;
+    double   load() const;
+    // empty the set, keeping the current table. Not safe alongside other
+    // calls.
+    void     clear();
+    // grow to at least capacity slots now, rather than as keys arrive
+    void     grow( uint64_t capacity );
+
+    // call fn on every key, in table order. Not safe alongside inserts.
+    template<typename F> void for_each( F fn ) const {
+        const Table *t = _current.load( std::memory_order_acquire );
+        for ( uint64_t idx(0); idx <= t->mask; ++idx )
+            if ( t->tags[idx].load( std::memory_order_acquire ) & TAG_READY )
+                fn( t->keys[idx] );
+    }
+
+private:
+    static const uint32_t TAG_READY = 0x80000000;
+    static const uint32_t TAG_USED  = 0x40000000;
+    static const uint32_t TAG_MOVED = 0x20000000;   // frozen by a move to the next table
+    static const uint32_t TAG_FP    = 0x1fffffff;
+    static const int      MAX_PROBE = 1024;
+    static const int      STRIPES   = 64;
+    static const uint64_t CHUNK     = 4096;         // slots moved at a time
+
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> cnt;
+    };
+
+    struct Table {
+        uint64_t                                 mask;
+        std::unique_ptr<std::atomic<uint32_t>[]> tags;
+        std::unique_ptr<BoardPacked[]>           keys;
+        std::atomic<Table *>                     next;      // being moved into, if any
+        std::atomic<uint64_t>                    claimed;   // chunks taken by movers
+        std::atomic<uint64_t>                    moved;     // chunks finished
+
+        Table( uint64_t capacity );
+        uint64_t chunks() const { return ( mask + CHUNK ) / CHUNK; }
+    };
+
+    Insert insert_into( Table *t, const BoardPacked& key, uint64_t h, bool counted );
+    void   start_move( Table *t, uint64_t capacity );
+    void   help_move( Table *t );
+    void   move_chunk( Table *t, uint64_t chunk );
+
+    std::atomic<Table *>                _current;
+    std::vector<std::unique_ptr<Table>> _tables;    // every table not yet freed
+    std::mutex                          _mtx;       // guards _tables and starting a move
+    // size is kept in striped counters, picked by hash, so concurrent
+    // inserts rarely share a cache line
+    Counter                             _size[STRIPES];
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "packstore.h"
+
+#define PACKSORT_FANIN 256      // most runs merged at once
+
+// External-memory sort and dedup of BoardPacked records
+//
+// Records are collected in a buffer of a fixed RAM budget. Each time it
+// fills it is radix sorted, its duplicates dropped, and the resulting
+// run appended to an (already unlinked) temporary file, which holds every
+// run. finish() then merges the runs, dropping duplicates across runs as
+// it goes, and hands each distinct record to a sink in BoardPacked byte
+// order. If nothing was spilled the buffer is sorted and emitted without
+// touching disk.
+//
+// A merge reads at most PACKSORT_FANIN runs at once, each through its own
+// slice of the buffer. With more runs than that, passes merge them that
+// many at a time into longer runs in a fresh file until one merge can
+// take them all - so the buffer stays within the budget and only two
+// files are ever open.
+//
+// add() may be called from many threads at once. A thread that fills the
+// buffer takes it and spills it without holding the lock, leaving a
+// fresh one for the rest, so while spills run the sorter can hold a full
+// buffer per spilling thread on top of the ram budget.
+
+// sort recs into BoardPacked byte order with an in-place MSD radix sort
+void radix_sort( BoardPacked *recs, size_t cnt );
+
+// drop adjacent duplicates from sorted recs, returning the new count
+size_t dedup_sorted( BoardPacked *recs, size_t cnt );
+
+typedef std::function<bool(const BoardPacked& rec)> PackSink;
+
+class PackSorter {
+public:
+    // ram_mb bounds the record buffer, which is also shared between the
+    // run readers during the merge. Runs are spilled to tmp_dir.
+    PackSorter( size_t ram_mb = 256, const std::string& tmp_dir = "/tmp" );
+    ~PackSorter();
+    PackSorter(const PackSorter&) = delete;
+    PackSorter& operator=(const PackSorter&) = delete;
+
+    // false if a run could not be spilled
+    bool add( const BoardPacked& rec );
+    bool add( const BoardPacked *recs, size_t cnt );
+
+    // Emit every distinct record in order. Stops early, returning false,
+    // if sink does or a run can't be read. The sorter is empty afterward.
+    // Not safe to call while other threads are adding.
+    bool finish( const PackSink& sink );
+    bool finish( PackStoreWriter& w );
+
+    uint64_t added() const;     // records passed to add()
+    uint64_t emitted() const;   // distinct records given to the sink
+    size_t   run_cnt() const;   // runs spilled to disk so far
+
+private:
+    struct Run {
+        uint64_t off;       // byte offset in the run file
+        uint64_t cnt;
+    };
+
+    int  open_tmp() const;
+    bool spill( std::vector<BoardPacked>& recs );
+    bool merge( const Run *runs, size_t cnt, const PackSink& sink );
+    bool merge_pass( size_t fanin );
+    void drop_runs();
+
+    std::string              _tmp_dir;
+    size_t                   _capacity;     // records
+    std::vector<BoardPacked> _buf;
+    std::vector<Run>         _runs;
+    int                      _fd;           // the run file, once something is spilled
+    uint64_t                 _end;          // bytes written to it
+    uint64_t                 _added;
+    uint64_t                 _emitted;
+    std::mutex               _mtx;      // guards _buf, _runs, _fd, _end and _added during add()
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+// PackStore - a sorted, read-only file of BoardPacked records, used in
+// place through mmap.
+//
+// The file is a one page header, then the records in BoardPacked byte
+// order starting on the next page, then (optionally) a sparse index.
+// The index holds the first key of every block of PACKSTORE_BLOCK
+// records - one 4K page - laid out in Eytzinger (breadth-first) order
+// so that a search walks down it touching one cache line per level, with
+// the top levels shared by every lookup and so always hot. The search
+// ends in a single page of records, which is then binary searched.
+//
+// Opening a store only maps it, so it takes the same time for any size
+// of file; pages are read in by the OS as lookups touch them.
+
+#define PACKSTORE_MAGIC   "GARTHPKS"
+#define PACKSTORE_VERSION 1
+#define PACKSTORE_PAGE    4096
+#define PACKSTORE_BLOCK   ( PACKSTORE_PAGE / sizeof(BoardPacked) )
+
+#pragma pack(1)
+struct PackStoreHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;       // sizeof(BoardPacked)
+    uint64_t record_cnt;
+    uint64_t record_off;        // file offset of the first record
+    uint64_t index_off;         // file offset of the index, 0 if none
+    uint64_t index_cnt;         // number of index keys (one per block)
+    uint64_t block_records;     // records per index block
+    uint8_t  unused[8];
+};
+#pragma pack()
+
+class PackStore {
+public:
+    PackStore();
+    ~PackStore();
+    PackStore(const PackStore&) = delete;
+    PackStore& operator=(const PackStore&) = delete;
+
+    // map the store at path, returning false if it can't be opened or
+    // is not a store.
+    bool open( const std::string& path );
+    void close();
+    bool is_open() const;
+
+    uint64_t size() const;
+    bool     has_index() const;
+    const BoardPacked& operator[]( uint64_t idx ) const;
+    const BoardPacked *begin() const;
+    const BoardPacked *end() const;
+
+    // index of the first record not less than key - size() if none
+    uint64_t lower_bound( const BoardPacked& key ) const;
+    bool     contains( const BoardPacked& key ) const;
+    bool     find( const BoardPacked& key, uint64_t& idx ) const;
+
+private:
+    // the block whose first key is the last one <= key, or -1
+    int64_t find_block( const BoardPacked& key ) const;
+
+    int                _fd;
+    uint8_t           *_map;
+    size_t             _map_size;
+    uint64_t           _cnt;
+    const BoardPacked *_recs;
+    uint64_t           _index_cnt;
+    const BoardPacked *_index;      // Eytzinger order, 1-based
+    const uint64_t    *_blocks;     // block number of each index entry
+};
+
+// PackStoreWriter - write a store from distinct records given in sorted
+// order.
+// Records are streamed to disk as they are added; only the index keys
+// (one per 128 records) are held in memory until close().
+class PackStoreWriter {
+public:
+    PackStoreWriter();
+    ~PackStoreWriter();
+
+    // start a store at path, first closing (and so finishing) any store
+    // still open
+    bool open( const std::string& path, bool with_index = true );
+    // false if the record is out of order or a duplicate, or the write
+    // failed
+    bool add( const BoardPacked& rec );
+    bool add( const BoardPacked *recs, size_t cnt );
+    // write the index and header. The store is not valid until this
+    // returns true.
+    bool close();
+    uint64_t count() const;
+
+    // sort and dedup recs and write them to a store at path
+    static bool write( const std::string& path, BoardPackedList& recs, bool with_index = true );
+
+private:
+    bool flush();
+
+    int                      _fd;
+    bool                     _with_index;
+    bool                     _ok;
+    uint64_t                 _cnt;
+    BoardPacked              _last;
+    std::vector<BoardPacked> _buf;
+    std::vector<BoardPacked> _firsts;   // first key of each block
+};
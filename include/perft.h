@@ -0,0 +1,41 @@
+#pragma once
+
+#include <iostream>
+
+#include "board.h"
+#include "move.h"
+#include "perfttable.h"
+
+// Perft - count the leaf nodes of the legal move tree to a given depth.
+//
+// Comparing the counts against published values is the standard check
+// that move generation and make/unmake are correct, and the time taken
+// is a good measure of how fast they are.
+
+// A well known test position with its published node counts.
+struct PerftPosition {
+    const char *name;
+    const char *fen;
+    uint64_t    nodes[8];   // expected count for depth 1..8, 0 if not listed
+};
+
+extern const PerftPosition perft_positions[];
+extern const int           perft_position_cnt;
+
+// Count leaf nodes depth plies below b. With bulk set, the last ply is
+// counted from the legal move count instead of being made one by one.
+// b is left as it was found.
+uint64_t perft( Board& b, int depth, bool bulk = true );
+
+// As perft(), but look up and record subtree counts in tt so that
+// transpositions are only counted once.
+uint64_t perft_hashed( Board& b, int depth, PerftTable& tt, bool bulk = true );
+
+// As perft(), but write the count below each root move to os.
+uint64_t perft_divide( Board& b, int depth, std::ostream& os, bool bulk = true );
+
+// Count the legal moves in moves, which must have been generated for b.
+int count_legal( Board& b, const MoveArray& moves );
+
+// long algebraic (UCI) text for a move, e.g. e2e4, e7e8q, e1g1
+std::string move_text( MovePacked mov );
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// PerftTable - a fixed-size transposition table of perft subtree counts,
+// keyed on (Zobrist key, depth) and safe to share between threads
+// without locks.
+//
+// Each entry is two 64-bit words: the data (node count and depth) and
+// a check word holding key ^ data. A reader accepts an entry only if the
+// two words it read XOR back to the key it wants, so an entry torn by a
+// concurrent writer simply reads as a miss. Entries are grouped four to
+// a 64-byte bucket; a store replaces the shallowest entry in its bucket.
+class PerftTable {
+public:
+    // size in megabytes, rounded down to a power of two number of buckets
+    PerftTable(size_t mb);
+
+    bool   probe(uint64_t key, int depth, uint64_t& nodes) const;
+    void   store(uint64_t key, int depth, uint64_t nodes);
+    void   clear();
+    size_t size_bytes() const;
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check;    // key ^ data
+        std::atomic<uint64_t> data;     // nodes << 8 | depth
+    };
+
+    struct alignas(64) Bucket {
+        Entry entries[4];
+    };
+
+    std::unique_ptr<Bucket[]> _buckets;
+    uint64_t                  _mask;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "board.h"
+#include "move.h"
+#include "threadpool.h"
+
+// PGN game collections
+//
+// PgnFile maps a PGN file and reads it a batch of about PGN_BATCH bytes
+// at a time. Each batch is cut into PGN_CHUNK sized pieces, one task
+// each on a ThreadPool; a task moves its start up to the next game
+// boundary (a '[' and tag name opening a line that doesn't follow
+// another tag line and isn't inside a '{' comment), and parses
+// every game that starts in its piece. The games are then handed to the
+// caller's sink one at a time, in file order, on the calling thread.
+//
+// SAN moves are resolved in place against get_legal_moves() of the
+// position they are played in - the token is never copied. Comments,
+// variations, NAGs, move numbers and annotation marks are skipped.
+
+#define PGN_BATCH ( 64 << 20 )
+#define PGN_CHUNK ( 1 << 20 )
+
+struct PgnGame {
+    uint64_t         index;         // 0-based, in file order
+    uint64_t         offset;        // byte offset of the game in the file
+    std::string_view text;          // the whole game, tags and all
+    Board            start;         // from the FEN tag, else the initial position
+    MovePackedList   moves;         // as played, up to any error
+    std::string_view result;        // the game termination marker, if any
+
+    // Why the game could not be read in full, nullptr if it was. bad is
+    // the token at fault.
+    const char      *error;
+    std::string_view bad;
+
+    PgnGame();
+
+    // value of the named tag, empty if there is none
+    std::string_view tag( std::string_view name ) const;
+    // append the position before each move and after the last
+    void positions( BoardPackedList& out, bool identity = false ) const;
+};
+
+// called for each game. Returning false stops the read.
+typedef std::function<bool(const PgnGame& game)> PgnSink;
+
+// Resolve the SAN move in san for b, setting mov. False if it names no
+// legal move, or more than one.
+bool resolve_san( const Board& b, std::string_view san, MovePacked& mov );
+
+class PgnFile {
+public:
+    PgnFile();
+    ~PgnFile();
+    PgnFile(const PgnFile&) = delete;
+    PgnFile& operator=(const PgnFile&) = delete;
+
+    bool   open( const std::string& path );
+    void   close();
+    bool   is_open() const;
+    size_t bytes() const;
+
+    // Read every game, passing each to sink. Games with an error are
+    // passed too, with the moves before it. Returns the number of games
+    // passed.
+    uint64_t read( ThreadPool& pool, const PgnSink& sink, size_t batch = PGN_BATCH ) const;
+
+private:
+    int         _fd;
+    const char *_map;
+    size_t      _size;
+};
@@ -54,3 +54,13 @@ private:
     static const short ranges[];
 };
 
+// Helpers for the Piece::byte() encoding - piece type in the low three
+// bits, and 0x08 set for black pieces. A byte of 0 is an empty square.
+inline PieceType byte_type( uint8_t by ) { return PieceType( by & 0x07 ); }
+inline Side      byte_side( uint8_t by ) { return ( by & 0x08 ) ? SIDE_BLACK : SIDE_WHITE; }
+inline uint8_t   make_byte( PieceType pt, Side s ) {
+    return uint8_t( pt | ( IS_BLACK(s) ? 0x08 : 0x00 ) );
+}
+// same glyphs as Piece::glyph(), '.' for an empty square
+inline char      byte_glyph( uint8_t by ) { return ".KQBNRPP.kqbnrpp"[ by & 0x0f ]; }
+
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ThreadPool - a fixed set of worker threads with work stealing.
+//
+// Each worker has its own task queue. Tasks submitted from a worker go
+// on that worker's queue, which it runs newest-first (so a recursive
+// split stays depth-first and cache-warm), while idle workers steal the
+// oldest - and so typically largest - tasks from the other queues.
+// Tasks submitted from outside the pool are dealt round-robin.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // threads == 0 uses one worker per hardware thread
+    ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    unsigned size() const;
+    void     submit(Task task);
+    // run one pending task on the calling thread, returning false if
+    // there was none. Lets a thread waiting on tasks help out.
+    bool     run_one();
+
+    // index of the calling worker in 0..size()-1 of its pool, or -1 if
+    // the caller is not a pool worker.
+    static int worker_index();
+
+private:
+    struct Queue {
+        std::mutex       mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread>            _threads;
+    std::atomic<bool>                   _stop;
+    std::atomic<int>                    _pending;
+    std::atomic<unsigned>               _next;
+    std::mutex                          _mtx;
+    std::condition_variable             _cv;
+
+    void worker(unsigned idx);
+    bool pop(unsigned idx, Task& task);
+    bool steal(unsigned idx, Task& task);
+};
+
+// TaskGroup - a set of tasks that can be waited on together. Tasks in
+// the group may add further tasks to it; wait() returns once all of
+// them have finished, running pending tasks itself in the meantime.
+class TaskGroup {
+private:
+    ThreadPool&      _pool;
+    std::atomic<int> _cnt;
+
+public:
+    TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    void run(ThreadPool::Task task);
+    void wait();
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+
+#include "board.h"
+#include "move.h"
+#include "perfttable.h"
+#include "threadpool.h"
+
+// Parallel tree walking
+//
+// The legal move tree below a position is split into tasks at the root
+// and the next few plies (split_plies), each task carrying its own copy
+// of the board. Below the split each task walks its subtree with
+// make_move/unmake_move on that copy, so threads share nothing but the
+// visitor. Tasks run on a work-stealing ThreadPool.
+
+// Called for every node visited, possibly from several threads at once.
+// ply is the distance from the root. worker identifies the calling
+// thread - 0..pool.size()-1 for pool workers, pool.size() for the thread
+// that called walk_tree() - so visitors can keep per-thread state
+// without locking.
+typedef std::function<void(const Board& b, int ply, int worker)> NodeVisitor;
+
+// Visit every node from the root (ply 0) down to depth plies, returning
+// the number of nodes visited.
+uint64_t walk_tree( const Board& root, int depth, ThreadPool& pool,
+                    const NodeVisitor& visit, int split_plies = 2 );
+
+// Perft on all of the pool's threads. Gives the same count as perft().
+// If tt is given, it is shared by all threads as in perft_hashed().
+uint64_t perft_parallel( const Board& root, int depth, ThreadPool& pool,
+                         bool bulk = true, int split_plies = 2,
+                         PerftTable *tt = nullptr );
+
@@ -1,8 +1,18 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
 
 std::vector<std::string> split(std::string target, std::string delimiter);
 
+
+// write all len bytes of buf to fd, retrying short writes. False if a
+// write fails.
+bool write_all( int fd, const void *buf, size_t len );
+
+// write all len bytes of buf to fd at offset off, retrying short writes.
+// False if a write fails.
+bool pwrite_all( int fd, const void *buf, size_t len, uint64_t off );
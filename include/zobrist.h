@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Zobrist hashing keys
+//
+// A position's key is the XOR of a random value for each piece on its
+// square, for each castling right held, for the en passant file (if
+// any), and for black being on-move. Clocks are not part of the key.
+// Since XOR is its own inverse, the key is updated incrementally as
+// pieces and flags change.
+//
+// The values are generated at compile time from a fixed seed, so keys
+// are stable across runs and builds.
+
+struct ZobristKeys {
+    uint64_t piece[16][64];     // indexed by Piece::byte() and square
+    uint64_t castle[4];         // white queenside, white kingside, black queenside, black kingside
+    uint64_t en_passant[8];     // indexed by file
+    uint64_t on_move;           // black on-move
+};
+
+#define ZOBRIST_CASTLE_WHITE_QUEENSIDE 0
+#define ZOBRIST_CASTLE_WHITE_KINGSIDE  1
+#define ZOBRIST_CASTLE_BLACK_QUEENSIDE 2
+#define ZOBRIST_CASTLE_BLACK_KINGSIDE  3
+
+extern const ZobristKeys zobrist;
@@ -0,0 +1,125 @@
+// perft - move generation correctness and speed check
+//
+// usage: perft [-d depth] [-t threads] [-hash mb] [-divide] [-nobulk] [fen]
+//        perft -suite [-d depth] [-t threads] [-hash mb]
+//
+// With a FEN (or the initial position if none is given) count the leaf
+// nodes to depth, optionally broken down by root move. With -suite, run
+// every standard position to depth (or to its deepest listed count if
+// shallower) and compare against the published counts. -t runs on a
+// pool of threads (0 for one per hardware thread) - divide is serial.
+// -hash caches subtree counts in a table of the given size, shared by
+// all threads.
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "garth.h"
+#include "perft.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed( Clock::time_point start ) {
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+static void report( uint64_t nodes, double secs ) {
+    std::cout << nodes << " nodes in " << secs << "s";
+    if ( secs > 0 )
+        std::cout << " (" << uint64_t( nodes / secs ) << " nodes/sec)";
+    std::cout << std::endl;
+}
+
+static uint64_t count( Board& b, int depth, bool bulk, ThreadPool *pool, PerftTable *tt ) {
+    if ( pool )
+        return perft_parallel( b, depth, *pool, bulk, 2, tt );
+    return ( tt ) ? perft_hashed( b, depth, *tt, bulk )
+                  : perft( b, depth, bulk );
+}
+
+static int run_suite( int max_depth, bool bulk, ThreadPool *pool, PerftTable *tt ) {
+    int      failed(0);
+    uint64_t total(0);
+    auto     start = Clock::now();
+    for ( int idx(0); idx < perft_position_cnt; ++idx ) {
+        const PerftPosition& pos = perft_positions[idx];
+        for ( int depth(1); depth <= max_depth && depth <= 8; ++depth ) {
+            uint64_t expect = pos.nodes[depth - 1];
+            if ( expect == 0 )
+                continue;
+            Board    b(pos.fen);
+            auto     t0    = Clock::now();
+            uint64_t nodes = count( b, depth, bulk, pool, tt );
+            double   secs  = elapsed(t0);
+            total += nodes;
+            bool ok = nodes == expect;
+            if ( !ok )
+                failed++;
+            std::cout << ( ok ? "PASS " : "FAIL " ) << pos.name << " depth " << depth << ": ";
+            if ( !ok )
+                std::cout << "(expected " << expect << ") ";
+            report( nodes, secs );
+        }
+    }
+    std::cout << "total: ";
+    report( total, elapsed(start) );
+    if ( failed )
+        std::cout << failed << " FAILED" << std::endl;
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int         depth(5);
+    bool        divide(false);
+    bool        bulk(true);
+    bool        suite(false);
+    int         threads(-1);
+    int         hash_mb(0);
+    std::string fen(Board::init_pos_fen);
+
+    for ( int idx(1); idx < argc; ++idx ) {
+        if ( !std::strcmp( argv[idx], "-d" ) && idx + 1 < argc ) {
+            depth = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-t" ) && idx + 1 < argc ) {
+            threads = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-hash" ) && idx + 1 < argc ) {
+            hash_mb = std::atoi( argv[++idx] );
+        } else if ( !std::strcmp( argv[idx], "-divide" ) ) {
+            divide = true;
+        } else if ( !std::strcmp( argv[idx], "-nobulk" ) ) {
+            bulk = false;
+        } else if ( !std::strcmp( argv[idx], "-suite" ) ) {
+            suite = true;
+        } else if ( argv[idx][0] == '-' ) {
+            std::cerr << "usage: perft [-d depth] [-t threads] [-hash mb] [-divide] [-nobulk] [-suite] [fen]" << std::endl;
+            return 2;
+        } else {
+            fen = argv[idx];
+        }
+    }
+
+    std::unique_ptr<ThreadPool> pool;
+    if ( threads >= 0 ) {
+        pool = std::make_unique<ThreadPool>( threads );
+        std::cout << "using " << pool->size() << " threads" << std::endl;
+    }
+
+    std::unique_ptr<PerftTable> tt;
+    if ( hash_mb > 0 ) {
+        tt = std::make_unique<PerftTable>( hash_mb );
+        std::cout << "using " << ( tt->size_bytes() >> 20 ) << "MB hash" << std::endl;
+    }
+
+    if ( suite )
+        return run_suite( depth, bulk, pool.get(), tt.get() );
+
+    Board    b(fen);
+    auto     start = Clock::now();
+    uint64_t nodes = ( divide ) ? perft_divide( b, depth, std::cout, bulk )
+                                : count( b, depth, bulk, pool.get(), tt.get() );
+    std::cout << "depth " << depth << ": ";
+    report( nodes, elapsed(start) );
+    return 0;
+}
@@ -3,72 +3,180 @@
 #include "board.h"
 
 void Board::apply_move(Move& mov, Board& cpy) {
-    // first, create a scratch copy of this board to modify
+    // first, create a scratch copy of this board to modify. The board
+    // is plain data, so this is a flat copy.
     cpy = *this;
 
     // now, all operations are done on cpy
-    PiecePtr src = cpy.at(mov.org);
-    PiecePtr trg = cpy.at(mov.dst);
-    Side     opp = OTHER_SIDE(src->side());
+    Side     opp = OTHER_SIDE( byte_side( _mailbox[mov.org.rnf()] ) );
+    MoveUndo undo;
+    cpy.make_move( mov.pack(), undo );
 
-    switch( mov.action )
+    // at this point check if either king is in check, mark the move
+    // accordingly.
+    int check = cpy.test_for_check(opp);
+    if      (check > 1) mov.result = MR_DOUBLE_CHECK;
+    else if (check > 0) mov.result = MR_CHECK;
+}
+
+// Apply mov to this board in place, saving in undo what is needed to
+// take it back with unmake_move().
+void Board::make_move(MovePacked mov, MoveUndo& undo) {
+    int       org  = mov.f.source;
+    int       dst  = mov.f.target;
+    uint8_t   by   = _mailbox[org];
+    Side      side = byte_side(by);
+    int       fwd  = ( IS_BLACK(side) ) ? -8 : 8;
+    Rank      home = ( IS_BLACK(side) ) ? R8 : R1;
+
+    undo.moved                  = by;
+    undo.captured               = 0;
+    undo.castle_white_queenside = _castle_white_queenside;
+    undo.castle_white_kingside  = _castle_white_kingside;
+    undo.castle_black_queenside = _castle_black_queenside;
+    undo.castle_black_kingside  = _castle_black_kingside;
+    undo.en_passant             = _en_passant;
+    undo.half_move_clock        = _half_move_clock;
+    undo.full_move_cnt          = _full_move_cnt;
+    undo.key                    = _key;
+
+    clear_en_passant();
+    // increment the half-move clock for 50-move rule
+    _half_move_clock++;
+
+    switch( mov.f.action )
     {
     case MV_CASTLE_KINGSIDE:
-        // mov.getSource() is the location of the king,
-        // mov.getTarget() is the location of the rook
-        // Move king to Fg, rook to Ff
-        move_piece( src, Square(mov.org.rank(), Fg));
-        move_piece( trg, Square(mov.dst.rank(), Ff));
+        // source is the location of the king, target the location of
+        // the rook. Move king to Fg, rook to Ff
+        remove_byte( dst );
+        move_byte( org, RNF(home, Fg) );
+        put_byte( RNF(home, Ff), make_byte(PT_ROOK, side) );
         break;
     case MV_CASTLE_QUEENSIDE:
-        // mov.getSource() is the location of the king,
-        // mov.getTarget() is the location of the rook
         // Move king to Fc, rook to Fd
-        move_piece( src, Square(mov.org.rank(), Fc));
-        move_piece( trg, Square(mov.dst.rank(), Fd));
+        remove_byte( dst );
+        move_byte( org, RNF(home, Fc) );
+        put_byte( RNF(home, Fd), make_byte(PT_ROOK, side) );
         break;
-    case MV_PROM_QUEEN:  
-        move_piece( src, mov.dst );
-        src->promote(PT_QUEEN);  
-        break; 
-    case MV_PROM_BISHOP: 
-        move_piece( src, mov.dst );
-        src->promote(PT_BISHOP); 
+    case MV_PROM_QUEEN:
+    case MV_PROM_BISHOP:
+    case MV_PROM_KNIGHT:
+    case MV_PROM_ROOK:
+        undo.captured = _mailbox[dst];
+        remove_byte( org );
+        put_byte( dst, make_byte( ( mov.f.action == MV_PROM_QUEEN  ) ? PT_QUEEN
+                                : ( mov.f.action == MV_PROM_BISHOP ) ? PT_BISHOP
+                                : ( mov.f.action == MV_PROM_KNIGHT ) ? PT_KNIGHT
+                                                                     : PT_ROOK, side ) );
+        _half_move_clock = 0;
         break;
-    case MV_PROM_KNIGHT: 
-        move_piece( src, mov.dst );
-        src->promote(PT_KNIGHT); 
+    case MV_EN_PASSANT:
+        // move the piece, but remove the pawn "passed by", which is
+        // one square back toward the side on-move.
+        undo.captured = _mailbox[dst - fwd];
+        remove_byte( dst - fwd );
+        move_byte( org, dst );
+        break;
+    default:
+        undo.captured = _mailbox[dst];
+        move_byte( org, dst );
         break;
-    case MV_PROM_ROOK:   
-        move_piece( src, mov.dst );
-        src->promote(PT_ROOK);   
+    }
+
+    if ( undo.captured )
+        _half_move_clock = 0;
+
+    PieceType pt = byte_type(by);
+    if ( pt == PT_PAWN || pt == PT_PAWN_OFF ) {
+        // pawn move resets the half-move-clock
+        _half_move_clock = 0;
+        if ( sq_file(org) != sq_file(dst) ) {
+            // pawn has moved off it's original file
+            if ( pt == PT_PAWN && _mailbox[dst] == by )
+                put_byte( dst, make_byte(PT_PAWN_OFF, side) );
+        } else if ( dst - org == 2 * fwd ) {
+            // en passant target is the square the pawn passed over
+            set_en_passant( Square( RnF(org + fwd) ) );
+        }
+    }
+
+    // a king or rook leaving its home square, or a rook being captured
+    // on its home square, ends castling on that side.
+    update_castle_rights( org );
+    update_castle_rights( dst );
+
+    // if this is a black move, then update the move count
+    if ( IS_BLACK(side) )
+        _full_move_cnt++;
+
+    toggle_on_move();
+}
+
+// Take back mov, which must be the last move made with make_move().
+void Board::unmake_move(MovePacked mov, const MoveUndo& undo) {
+    int       org  = mov.f.source;
+    int       dst  = mov.f.target;
+    Side      side = byte_side(undo.moved);
+    Rank      home = ( IS_BLACK(side) ) ? R8 : R1;
+
+    toggle_on_move();
+
+    switch( mov.f.action )
+    {
+    case MV_CASTLE_KINGSIDE:
+        remove_byte( RNF(home, Fg) );
+        remove_byte( RNF(home, Ff) );
+        put_byte( dst, make_byte(PT_ROOK, side) );
         break;
-    case MV_MOVE:
-    case MV_CAPTURE:
-        move_piece( src, mov.dst );
+    case MV_CASTLE_QUEENSIDE:
+        remove_byte( RNF(home, Fc) );
+        remove_byte( RNF(home, Fd) );
+        put_byte( dst, make_byte(PT_ROOK, side) );
         break;
     case MV_EN_PASSANT:
-        // move the piece, but remove the pawn "passed by"
-        //    a  b  c         a  b  c
-        //   +--+--+--+      +--+--+--+
-        // 6 |  | P|  |    4 | p|xP|  |
-        //   +--/--+--+      +--\--+--+
-        // 5 | P|xp|  |    3 |  | p|  |
-        //   +--+--+--+      +--+--+--+
-        //
-        move_piece( src, mov.dst );
-        // the pawn 'passed by' will be one square toward on-move
-        Dir d = IS_BLACK(src->side()) ? UP : DN;
-        Square s = mov.dst + offs[d];
-        // remove the piece from the board, but prob. need to record this somewhere.
-        clear_square( s );
+        remove_byte( dst );
+        put_byte( dst + ( ( IS_BLACK(side) ) ? 8 : -8 ), undo.captured );
+        break;
+    default:
+        remove_byte( dst );
+        if ( undo.captured )
+            put_byte( dst, undo.captured );
         break;
     }
-    // at this point check if either king is in check, mark the move
-    // accordingly.
-    int check = test_for_check(opp);
-    if      (check > 1) mov.result = MR_DOUBLE_CHECK;
-    else if (check > 0) mov.result = MR_CHECK;
+    put_byte( org, undo.moved );
+
+    _castle_white_queenside = undo.castle_white_queenside;
+    _castle_white_kingside  = undo.castle_white_kingside;
+    _castle_black_queenside = undo.castle_black_queenside;
+    _castle_black_kingside  = undo.castle_black_kingside;
+    _en_passant             = undo.en_passant;
+    _half_move_clock        = undo.half_move_clock;
+    _full_move_cnt          = undo.full_move_cnt;
+    _key                    = undo.key;
+}
+
+void Board::move_byte( int org, int dst ) {
+    uint8_t by = _mailbox[org];
+    remove_byte( org );
+    put_byte( dst, by );
+}
+
+void Board::update_castle_rights( int idx ) {
+    switch ( idx ) {
+        case RNF(R1,Fa): set_castle_white_queenside( false ); break;
+        case RNF(R1,Fh): set_castle_white_kingside( false );  break;
+        case RNF(R8,Fa): set_castle_black_queenside( false ); break;
+        case RNF(R8,Fh): set_castle_black_kingside( false );  break;
+        case RNF(R1,Fe):
+            set_castle_white_queenside( false );
+            set_castle_white_kingside( false );
+            break;
+        case RNF(R8,Fe):
+            set_castle_black_queenside( false );
+            set_castle_black_kingside( false );
+            break;
+    }
 }
 
 void Board::move_piece(PiecePtr ptr, Square dst) {
@@ -83,6 +191,7 @@ void Board::move_piece(PiecePtr ptr, Square dst) {
 
     // set the square of the space to dst
     Square org = ptr->square();
+    clear_square(org);
     place(ptr, dst);
     // increment the half-move clock for 50-move rule
     _half_move_clock++;
@@ -121,6 +230,7 @@ void Board::move_piece(PiecePtr ptr, Square dst) {
             if ( org.file() != dst.file() ) {
                 // pawn has moved off it's original file
                 ptr->promote( PT_PAWN_OFF );    
+                place( ptr, dst );
             } else if ( org.rank() == ( ( ptr->side() ) ? R7 : R2 ) &&
                         dst.rank() == ( ( ptr->side() ) ? R5 : R4 )
             ) {
@@ -0,0 +1,153 @@
+#include <vector>
+
+#include "attacks.h"
+
+static constexpr LeaperAttacks make_leaper_attacks() {
+    LeaperAttacks la{};
+    for ( int idx(0); idx < 64; ++idx ) {
+        Bitboard bit = 1ULL << idx;
+        la.knight[idx]             = knight_attacks_bb(bit);
+        la.king[idx]               = king_attacks_bb(bit);
+        la.pawn[SIDE_WHITE][idx]   = pawn_attacks_bb( bit, SIDE_WHITE );
+        la.pawn[SIDE_BLACK][idx]   = pawn_attacks_bb( bit, SIDE_BLACK );
+    }
+    return la;
+}
+
+// constant-initialized, so usable from any static initializer
+constexpr LeaperAttacks leaper_attacks = make_leaper_attacks();
+
+Magic rook_magics[64];
+Magic bishop_magics[64];
+
+#if ATTACKS_USE_PEXT
+const bool attacks_built_for_pext = true;
+#else
+const bool attacks_built_for_magic = true;
+#endif
+
+// 102400 rook and 5248 bishop entries cover every square's occupancy
+// subsets when each square uses exactly popcount(mask) index bits.
+static Bitboard rook_table[0x19000];
+static Bitboard bishop_table[0x1480];
+
+Bitboard slider_attacks( PieceType pt, int idx, Bitboard occ ) {
+    switch ( pt ) {
+        case PT_QUEEN:  return queen_attacks( idx, occ );
+        case PT_BISHOP: return bishop_attacks( idx, occ );
+        case PT_ROOK:   return rook_attacks( idx, occ );
+        default:        return BB_EMPTY;
+    }
+}
+
+// Directions are listed here rather than using axes_dirs/diag_dirs, as
+// those are not guaranteed to be constructed before the static
+// initializer below runs.
+static const Dir rook_dirs[4]   = { UP, DN, LFT, RGT };
+static const Dir bishop_dirs[4] = { UPL, UPR, DNL, DNR };
+
+// walk each direction from idx until the edge of the board or an
+// occupied square - which is included, as it may be captured.
+static Bitboard ray_attacks( int idx, const Dir (&dirs)[4], Bitboard occ ) {
+    Bitboard bb(BB_EMPTY);
+    for ( Dir dir : dirs ) {
+        Square here = Square( RnF(idx) );
+        while ( true ) {
+            here += offs[dir];
+            if ( !here.in_bounds() )
+                break;
+            bb |= bb_bit(here);
+            if ( occ & bb_bit(here) )
+                break;
+        }
+    }
+    return bb;
+}
+
+// xorshift64* generator used to search for magics. Seeded per rank
+// with values known to find all magics quickly, so startup is both
+// fast and deterministic.
+class MagicRng {
+    uint64_t _s;
+public:
+    MagicRng( uint64_t seed ) : _s(seed) {}
+    uint64_t next() {
+        _s ^= _s >> 12;
+        _s ^= _s << 25;
+        _s ^= _s >> 27;
+        return _s * 2685821657736338717ULL;
+    }
+    // magics work best with few bits set
+    uint64_t sparse() { return next() & next() & next(); }
+};
+
+static void init_slider( Magic *magics, Bitboard *table, const Dir (&dirs)[4] ) {
+    static const uint64_t seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+
+    std::vector<Bitboard> occupancy(4096);
+    std::vector<Bitboard> reference(4096);
+    std::vector<int>      epoch(4096, 0);
+    int                   cnt(0);
+    Bitboard             *next = table;
+
+    for ( int idx(0); idx < 64; ++idx ) {
+        Magic& m = magics[idx];
+        // the outermost square of a ray never blocks anything beyond it,
+        // so board edges (other than the slider's own rank/file) are
+        // left out of the mask.
+        Bitboard edges = ( ( BB_RANK_1 | BB_RANK_8 ) & ~( BB_RANK_1 << ( 8 * sq_rank(idx) ) ) )
+                       | ( ( BB_FILE_A | BB_FILE_H ) & ~( BB_FILE_A << sq_file(idx) ) );
+        m.mask    = ray_attacks( idx, dirs, BB_EMPTY ) & ~edges;
+        m.shift   = 64 - bb_count( m.mask );
+        m.magic   = 0;
+        m.attacks = next;
+
+        // enumerate every subset of the mask (Carry-Rippler) along with
+        // the attacks it produces.
+        int      size(0);
+        Bitboard occ(BB_EMPTY);
+        do {
+            occupancy[size] = occ;
+            reference[size] = ray_attacks( idx, dirs, occ );
+            if ( ATTACKS_USE_PEXT )
+                m.attacks[ m.index(occ) ] = reference[size];
+            size++;
+            occ = ( occ - m.mask ) & m.mask;
+        } while ( occ );
+        next += size;
+
+        if ( ATTACKS_USE_PEXT )
+            continue;
+
+        // search for a magic that maps every subset to a slot without
+        // a destructive collision. epoch[] marks slots written in the
+        // current attempt so the table need not be cleared each time.
+        MagicRng rng( seeds[ sq_rank(idx) ] );
+        for ( int i(0); i < size; ) {
+            for ( m.magic = 0; bb_count( ( m.magic * m.mask ) >> 56 ) < 6; )
+                m.magic = rng.sparse();
+
+            for ( ++cnt, i = 0; i < size; ++i ) {
+                unsigned k = unsigned( ( occupancy[i] * m.magic ) >> m.shift );
+                if ( epoch[k] < cnt ) {
+                    epoch[k]     = cnt;
+                    m.attacks[k] = reference[i];
+                } else if ( m.attacks[k] != reference[i] ) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void init_attacks() {
+    init_slider( rook_magics,   rook_table,   rook_dirs );
+    init_slider( bishop_magics, bishop_table, bishop_dirs );
+}
+
+// build the tables before main() runs
+static struct AttacksInit {
+    AttacksInit() {
+        init_attacks();
+    }
+} attacks_init;
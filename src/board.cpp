@@ -1,17 +1,21 @@
 #include <iostream>
 
+#include <cstring>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <utility>
 #include <vector>
 
+#include "attacks.h"
 #include "constants.h"
 #include "move.h"
 #include "board.h"
+#include "zobrist.h"
 
 
 Board::Board(bool initial_position) {
+    clear();
     if ( initial_position )
         set_initial_position();
 }
@@ -28,17 +32,16 @@ Board::Board(BoardPacked pack) {
     unpack(pack);
 }
 
-int Board::piece_cnt() { return _pm.size(); }
+int Board::piece_cnt() const { return bb_count( occupied() ); }
 
 PiecePtr Board::at( Rank r, File f ) const {
     return at( Square(r,f) );
 }
 
 PiecePtr Board::at( Square squ ) const {
-    auto itr = _pm.find( squ );
-    if ( itr != _pm.end() )
-        return itr->second;       
-    // if square is empty, create a temporary Piece that
+    if ( squ.in_bounds() )
+        return piece_at( squ.rnf() );
+    // if square is off the board, create a temporary Piece that
     // has the location we need.
     PiecePtr mt = std::make_shared<Piece>(PT_EMPTY, SIDE_WHITE);
     mt->place(squ);
@@ -50,11 +53,28 @@ bool Board::is_empty(Rank r, File f) const {
 }
 
 bool Board::is_empty(Square squ) const {
-    return at(squ)->type() == PT_EMPTY;
+    return !squ.in_bounds() || _mailbox[squ.rnf()] == 0;
+}
+
+uint8_t Board::byte_at( Square squ ) const {
+    return ( squ.in_bounds() ) ? _mailbox[squ.rnf()] : 0;
+}
+
+PieceType Board::type_at( Square squ ) const {
+    return byte_type( byte_at(squ) );
+}
+
+Side Board::side_at( Square squ ) const {
+    uint8_t by = byte_at(squ);
+    return ( by ) ? byte_side(by) : SIDE_NONE;
+}
+
+char Board::glyph_at( Square squ ) const {
+    return byte_glyph( byte_at(squ) );
 }
 
 void Board::clear_square(Square squ) { 
-    _pm.erase(squ);
+    remove_byte( squ.rnf() );
 }
 
 PiecePtr Board::set( Rank r, File f, PieceType pt, Side s ) {
@@ -73,10 +93,104 @@ PiecePtr Board::set( Square squ, PieceType pt, Side s ) {
 
 void Board::place( PiecePtr pp, Square squ) {
     pp->place(squ);
-    _pm[squ] = pp;
-    // remember where the kings are
-    if ( pp->is_king() )
-        _kings[ pp->side() ] = pp;
+    if ( pp->is_empty() )
+        remove_byte( squ.rnf() );
+    else
+        put_byte( squ.rnf(), pp->byte() );
+}
+
+// remove all pieces and reset the game information
+void Board::clear() {
+    for ( auto& bb : _bb_type )
+        bb = BB_EMPTY;
+    _bb_side[SIDE_WHITE] = _bb_side[SIDE_BLACK] = BB_EMPTY;
+    std::memset( _mailbox, 0, sizeof(_mailbox) );
+
+    _on_move                = SIDE_WHITE;
+    _castle_white_queenside = false;
+    _castle_white_kingside  = false;
+    _castle_black_queenside = false;
+    _castle_black_kingside  = false;
+    _en_passant             = Square::UNBOUNDED;
+    _half_move_clock        = 0;
+    _full_move_cnt          = 0;
+    // an empty board with white on-move and no flags hashes to nothing
+    _key                    = 0;
+}
+
+Bitboard Board::occupied() const {
+    return _bb_side[SIDE_WHITE] | _bb_side[SIDE_BLACK];
+}
+
+Bitboard Board::side_bb( Side s ) const {
+    return _bb_side[s];
+}
+
+Bitboard Board::type_bb( PieceType pt ) const {
+    return _bb_type[pt];
+}
+
+// pawns that have moved off their file are still pawns
+Bitboard Board::pawns_bb( Side s ) const {
+    return ( _bb_type[PT_PAWN] | _bb_type[PT_PAWN_OFF] ) & _bb_side[s];
+}
+
+Square Board::king_square( Side s ) const {
+    Bitboard bb = _bb_type[PT_KING] & _bb_side[s];
+    return ( bb ) ? Square( RnF( bb_lsb(bb) ) ) : Square::UNBOUNDED;
+}
+
+void Board::put_byte( int idx, uint8_t by ) {
+    if ( _mailbox[idx] )
+        remove_byte( idx );
+    Bitboard bit = bb_bit(idx);
+    _key ^= zobrist.piece[by][idx];
+    _mailbox[idx] = by;
+    _bb_type[ byte_type(by) ] |= bit;
+    _bb_side[ byte_side(by) ] |= bit;
+}
+
+void Board::remove_byte( int idx ) {
+    uint8_t by = _mailbox[idx];
+    if ( by == 0 )
+        return;
+    Bitboard bit = bb_bit(idx);
+    _key ^= zobrist.piece[by][idx];
+    _mailbox[idx] = 0;
+    _bb_type[ byte_type(by) ] &= ~bit;
+    _bb_side[ byte_side(by) ] &= ~bit;
+}
+
+uint64_t Board::key() const {
+    return _key;
+}
+
+// compute the Zobrist key from scratch - key() should always equal this
+uint64_t Board::compute_key() const {
+    uint64_t key(0);
+    Bitboard bb = occupied();
+    while ( bb ) {
+        int idx = bb_pop(bb);
+        key ^= zobrist.piece[ _mailbox[idx] ][idx];
+    }
+    if ( _castle_white_queenside ) key ^= zobrist.castle[ZOBRIST_CASTLE_WHITE_QUEENSIDE];
+    if ( _castle_white_kingside  ) key ^= zobrist.castle[ZOBRIST_CASTLE_WHITE_KINGSIDE];
+    if ( _castle_black_queenside ) key ^= zobrist.castle[ZOBRIST_CASTLE_BLACK_QUEENSIDE];
+    if ( _castle_black_kingside  ) key ^= zobrist.castle[ZOBRIST_CASTLE_BLACK_KINGSIDE];
+    if ( has_en_passant() )
+        key ^= zobrist.en_passant[ _en_passant.file() ];
+    if ( IS_BLACK(_on_move) )
+        key ^= zobrist.on_move;
+    return key;
+}
+
+// create a Piece that reflects what is at square idx
+PiecePtr Board::piece_at( int idx ) const {
+    uint8_t  by  = _mailbox[idx];
+    PiecePtr pp  = std::make_shared<Piece>(byte_type(by), ( by ) ? byte_side(by) : SIDE_WHITE);
+    Square   squ = Square( RnF(idx) );
+    pp->place(squ);
+    return pp;
 }
 
 Side Board::get_on_move() const {
@@ -84,10 +198,13 @@ Side Board::get_on_move() const {
 }
 
 void Board::set_on_move(Side s) {
+    if ( s != _on_move )
+        _key ^= zobrist.on_move;
     _on_move = s;
 }
 
 void Board::toggle_on_move() {
+    _key ^= zobrist.on_move;
     _on_move = OTHER_SIDE(_on_move);
 }
 
@@ -96,7 +213,7 @@ bool Board::has_en_passant() const {
 }
 
 void Board::clear_en_passant() {
-    _en_passant = Square::UNBOUNDED;
+    set_en_passant( Square::UNBOUNDED );
 }
 
 Square Board::get_en_passant() const {
@@ -104,7 +221,11 @@ Square Board::get_en_passant() const {
 }
 
 void Board::set_en_passant(Square eps) {
+    if ( has_en_passant() )
+        _key ^= zobrist.en_passant[ _en_passant.file() ];
     _en_passant = eps;
+    if ( has_en_passant() )
+        _key ^= zobrist.en_passant[ _en_passant.file() ];
 }
 
 short Board::get_half_move_clock() const {
@@ -144,6 +265,8 @@ bool Board::get_castle_white_queenside() const {
 }
 
 void Board::set_castle_white_queenside(bool state) {
+    if ( state != _castle_white_queenside )
+        _key ^= zobrist.castle[ZOBRIST_CASTLE_WHITE_QUEENSIDE];
     _castle_white_queenside = state;
 }
 
@@ -152,6 +275,8 @@ bool Board::get_castle_white_kingside() const {
 }
 
 void Board::set_castle_white_kingside(bool state) {
+    if ( state != _castle_white_kingside )
+        _key ^= zobrist.castle[ZOBRIST_CASTLE_WHITE_KINGSIDE];
     _castle_white_kingside = state;
 }
 
@@ -160,6 +285,8 @@ bool Board::get_castle_black_queenside() const {
 }
 
 void Board::set_castle_black_queenside(bool state) {
+    if ( state != _castle_black_queenside )
+        _key ^= zobrist.castle[ZOBRIST_CASTLE_BLACK_QUEENSIDE];
     _castle_black_queenside = state;
 }
 
@@ -168,6 +295,8 @@ bool Board::get_castle_black_kingside() const {
 }
 
 void Board::set_castle_black_kingside(bool state) {
+    if ( state != _castle_black_kingside )
+        _key ^= zobrist.castle[ZOBRIST_CASTLE_BLACK_KINGSIDE];
     _castle_black_kingside = state;
 }
 
@@ -187,10 +316,9 @@ bool Board::side_can_castle_queenside(Side s) const {
 
 PieceList Board::get_side_pieces( Side s ) const {
     PieceList ret;
-    for ( auto pp : _pm ) {
-        if ( pp.second->side() == s )
-            ret.push_back(pp.second);
-    }
+    Bitboard  bb = _bb_side[s];
+    while ( bb )
+        ret.push_back( piece_at( bb_pop(bb) ) );
     return ret;
 }
 
@@ -198,41 +326,12 @@ void Board::set_initial_position() {
     from_fen(init_pos_fen);
 }
 
+// compatibility wrapper - generate into a MoveArray and copy out as MovePtrs
 MoveList& Board::get_moves(MoveList& moves) const {
-    for ( auto pp : _pm ) {
-        PiecePtr ptr( pp.second );
-        if ( ptr->moves_knight() ) {
-            Square org(ptr->square());
-            for(Dir dir : knight_moves) {
-                auto res = seek(ptr, dir, Square::UNBOUNDED);
-                if ( res.rc == Board::SEEKRC_OUT_OF_BOUNDS )
-                    continue;
-                
-                MoveAction ma = MV_NONE;
-                if ( res.rc == Board::SEEKRC_FOUND_OPPONENT ) {
-                    ma = MV_CAPTURE;
-                } else if ( res.rc == Board::SEEKRC_NOT_FOUND ) {
-                    ma = MV_MOVE;
-                }
-                if ( ma != MV_NONE )
-                    moves.push_back(Move::create(ma, MR_NONE, res.src, res.path.back()));
-            }
-            continue;
-        }
-        if ( ptr->moves_pawn() ) {
-            get_pawn_moves( ptr, moves );
-            continue;
-        }
-        if ( ptr->moves_axes() ) {
-            gather_moves(ptr, axes_dirs, moves);
-        }
-        if ( ptr->moves_diag() ) {
-            gather_moves(ptr, diag_dirs, moves);
-        }
-        if ( ptr->is_king() ) {
-            check_castle(ptr, moves);
-        }
-    }
+    MoveArray arr;
+    get_moves(arr);
+    for ( auto mp : arr )
+        moves.push_back(Move::create(mp));
     return moves;
 }
 
@@ -317,61 +416,73 @@ void Board::check_castle( PiecePtr ptr, MoveList& moves ) const {
     // so we seek from the king to the rook, and if the rook is found, then
     // check the path to see if any square (including the king) is currently
     // under attack.
-    SeekResult res;
-    if ( side_can_castle_kingside( ptr->side() ) ) {
+    Side   side = ptr->side();
+    Square king = ptr->square();
+    if ( side_can_castle_kingside(side) ) {
         RnF rook = (ptr->is_black()) ? h8 : a8;
-        res = seek(ptr,RGT,rook,7);
-        if ( res.rc == SEEKRC_FOUND_FRIENDLY && res.trg == res.path.back() ) {
-            bool is_clear(true);
-            for ( short idx(0); idx < res.path.size() - 1; ++idx )
-                if ( test_for_attack(at(res.path[idx]), ptr->side()) ) {
-                    is_clear = false;
-                    break;
-                }
-            if ( is_clear )
-                moves.push_back(Move::create( MV_CASTLE_KINGSIDE, MR_NONE, ptr->square(), rook));
-        }
+        if ( castle_path_clear( king, RGT, rook, side ) )
+            moves.push_back(Move::create( MV_CASTLE_KINGSIDE, MR_NONE, king, rook));
     }
-    if ( side_can_castle_queenside( ptr->side() ) ) {
+    if ( side_can_castle_queenside(side) ) {
         RnF rook = (ptr->is_black()) ? h1 : a1;
-        res = seek(ptr,LFT,rook,7);
-        if ( res.rc == SEEKRC_FOUND_FRIENDLY && res.trg == res.path.back() ) {
-            bool is_clear(true);
-            for ( short idx(0); idx < res.path.size() - 1; ++idx )
-                if ( test_for_attack(at(res.path[idx]), ptr->side()) ) {
-                    is_clear = false;
-                    break;
-                }
-            if ( is_clear )
-                moves.push_back(Move::create( MV_CASTLE_QUEENSIDE, MR_NONE, ptr->square(), rook));
-        }
+        if ( castle_path_clear( king, LFT, rook, side ) )
+            moves.push_back(Move::create( MV_CASTLE_QUEENSIDE, MR_NONE, king, rook));
     }
 }
 
-std::string Board::diagram() const {
-    std::stringstream ss;
-    for ( short r = R8; r >= R1; --r ) {
-        ss << char('a' + r) << ": ";
-        for( short f = Fa; f <= Fh; ++f ) {
-            PiecePtr pt = at((Rank)r,(File)f);
-            ss << pt->glyph() << ' ';
+// walk from the king toward the rook: true if the first piece met is a
+// friendly one on rook and no square before it is attacked
+bool Board::castle_path_clear( Square king, Dir dir, Square rook, Side s ) const {
+    Square here = king;
+    for ( short step(0); step < 7; ++step ) {
+        here += offs[dir];
+        if ( !here.in_bounds() )
+            return false;
+        if ( _mailbox[here.rnf()] )
+            return here == rook && byte_side( _mailbox[here.rnf()] ) == s;
+        if ( count_attacks( here.rnf(), s ) )
+            return false;
+    }
+    return false;
+}
+
+// Write the diagram for the board into buf, which must have room for
+// DIAGRAM_MAX chars. It is NUL terminated, and the NUL is returned.
+char *Board::diagram_to( char *buf ) const {
+    char *p = buf;
+    for ( int r = R8; r >= R1; --r ) {
+        *p++ = char('a' + r);
+        *p++ = ':';
+        *p++ = ' ';
+        for( int f = Fa; f <= Fh; ++f ) {
+            *p++ = byte_glyph( _mailbox[ RNF(r, f) ] );
+            *p++ = ' ';
         }
-        ss << std::endl;
+        *p++ = '\n';
     }
-    ss << "   1 2 3 4 5 6 7 8" << std::endl;
-    return ss.str();
+    const char *files = "   1 2 3 4 5 6 7 8\n";
+    std::memcpy( p, files, std::strlen(files) + 1 );
+    return p + std::strlen(files);
+}
+
+std::string Board::diagram() const {
+    char buf[DIAGRAM_MAX];
+    return std::string( buf, diagram_to(buf) );
 }
 
 void Board::gather_moves( PiecePtr pp, DirList dirs, MoveList& moves, bool isPawnCapture ) const {
+    Square org  = pp->square();
+    Side   side = pp->side();
+    int    rng  = pp->range();
     for (auto d : dirs) {
-        Square pos = pp->square();
+        Square pos = org;
         Offset o = offs[d];
-        int r = pp->range();
+        int r = rng;
         while ( r-- ) {
             pos += o;
             if( !pos.in_bounds() )
                 break; // walked off the edge of the board.
-            MovePtr mov = check_square(pp, pos, isPawnCapture);
+            MovePtr mov = check_square(org, side, pos, isPawnCapture);
             if (mov == nullptr)
                 break; // encountered a friendly piece - walk is over
             moves.push_back(mov);
@@ -382,10 +493,13 @@ void Board::gather_moves( PiecePtr pp, DirList dirs, MoveList& moves, bool isPaw
 }
 
 MovePtr Board::check_square(PiecePtr pp, Square dst, bool isPawnCapture ) const {
-    PiecePtr trg = at(dst);
-    Square   org = pp->square();
+    return check_square( pp->square(), pp->side(), dst, isPawnCapture );
+}
 
-    if ( trg->is_empty() ) {
+MovePtr Board::check_square( Square org, Side side, Square dst, bool isPawnCapture ) const {
+    uint8_t trg = _mailbox[dst.rnf()];
+
+    if ( trg == 0 ) {
         // empty square so record move and continue
         // for isPawnCapture, the move is only valid if the space
         // is occupied by an opposing piece. So, if it's empty
@@ -394,7 +508,7 @@ MovePtr Board::check_square(PiecePtr pp, Square dst, bool isPawnCapture ) const
                                : Move::create(MV_MOVE, MR_NONE, org, dst);
     }
 
-    if( trg->side() == pp->side()) {
+    if( byte_side(trg) == side) {
         // If friendly piece, do not record move and leave.
         return nullptr;
     }
@@ -405,7 +519,7 @@ MovePtr Board::check_square(PiecePtr pp, Square dst, bool isPawnCapture ) const
 Board::SeekResult Board::seek( PiecePtr src, Dir dir, PiecePtr trg, short range ) const {
     SeekResult res = seek(src, dir, trg->square(), range );
     if ( res.rc == SEEKRC_FOUND_FRIENDLY || res.rc == SEEKRC_FOUND_OPPONENT )
-        if ( res.enc == trg )
+        if ( res.path.back() == trg->square() )
             res.rc = SEEKRC_TARGET_FOUND;
     return res;
 }
@@ -416,6 +530,7 @@ Board::SeekResult Board::seek( PiecePtr src, Dir dir, Square dst, short range )
     res.trg   = dst;
     res.dir   = dir;
     res.range = (range > 0) ? range : src->range();
+    res.enc   = 0;
     res.rc    = SEEKRC_NONE;
 
     Square here = res.src;
@@ -428,9 +543,9 @@ Board::SeekResult Board::seek( PiecePtr src, Dir dir, Square dst, short range )
         }
         here = test;
         res.path.push_back(here);
-        res.enc = at(here);
-        if ( ! res.enc->is_empty() ) {
-            res.rc = ( src->is_black() == res.enc->is_black() ) 
+        if ( _mailbox[here.rnf()] ) {
+            res.enc = _mailbox[here.rnf()];
+            res.rc = ( src->side() == byte_side(res.enc) ) 
                     ? SEEKRC_FOUND_FRIENDLY 
                     : SEEKRC_FOUND_OPPONENT;
             break;
@@ -450,50 +565,36 @@ const char *Board::init_pos_fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w
 
 short Board::test_for_attack(PiecePtr trg, Side side) const {
     if (side == SIDE_NONE) side = trg->side();
-    Square     dst(trg->square());
-    PieceList  attackers(get_side_pieces(OTHER_SIDE(side)));
-    short      cnt(0);
-    SeekResult res;
-    Dir        dir;
-    for ( PiecePtr org : attackers ) {
-        Square src = org->square();
-        if ( org->moves_knight() ) {
-            for ( Dir dir : knight_moves ) {
-                if ( org->square() + offs[dir] == dst ) {
-                    cnt++;
-                    break;
-                }
-            }
-            // since knight cannot move like anything else, we're done for this cycle
-            continue;   
-        }
-        if ( org->moves_pawn() ) {
-            const DirList *dirs = ( IS_WHITE(side) ) ? &black_pawn_attack : &white_pawn_attack;
-            for ( Dir dir : *dirs ) {
-                if ( org->square() + offs[dir] == dst ) {
-                    cnt++;
-                    break;
-                }
-            }
-            // since pawn cannot move like anything else, we're done for this cycle
-            continue;
-        }
-        if ( org->moves_diag() && ( dir = src.diag_bearing(dst) ) != NOWHERE ) { 
-            res = seek( org, dir, trg );
-            if ( res.enc == trg )
-                cnt++;                     
-        }
-        if ( org->moves_axes() && ( dir = src.axes_bearing(dst) ) != NOWHERE ) {
-            res = seek( org, dir, trg );
-            if ( res.enc == trg )
-                cnt++;                     
-        }
-    }
-
-    return cnt;
+    return count_attacks( trg->square().rnf(), side );
 }
 
 short Board::test_for_check(Side s) const {
-    return test_for_attack(_kings[s]);
+    Bitboard king = _bb_type[PT_KING] & _bb_side[s];
+    return ( king ) ? count_attacks( bb_lsb(king), s ) : 0;
+}
+
+// count the pieces of the side opposing side that attack square dst
+short Board::count_attacks(int dst, Side side) const {
+    return bb_count( attackers_to( dst, OTHER_SIDE(side), occupied() ) );
 }
 
+// The pieces of side by that attack square idx, given occupancy occ.
+// Attacks are looked up from idx outward - a square is attacked by a
+// knight if a knight on it would attack that knight's square, and so on
+// for each piece type - so the cost does not depend on how many pieces
+// are on the board. occ lets callers ask about a position that differs
+// from this one, e.g. with the king lifted off its square.
+Bitboard Board::attackers_to( int idx, Side by, Bitboard occ ) const {
+    Bitboard rq  = _bb_type[PT_ROOK] | _bb_type[PT_QUEEN];
+    Bitboard bq  = _bb_type[PT_BISHOP] | _bb_type[PT_QUEEN];
+    Bitboard att = ( pawn_attacks( idx, OTHER_SIDE(by) ) & ( _bb_type[PT_PAWN] | _bb_type[PT_PAWN_OFF] ) )
+                 | ( knight_attacks(idx) & _bb_type[PT_KNIGHT] )
+                 | ( king_attacks(idx) & _bb_type[PT_KING] )
+                 | ( rook_attacks( idx, occ ) & rq )
+                 | ( bishop_attacks( idx, occ ) & bq );
+    return att & _bb_side[by] & occ;
+}
+
+Bitboard Board::attackers_to( int idx, Side by ) const {
+    return attackers_to( idx, by, occupied() );
+}
@@ -0,0 +1,241 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "deltastore.h"
+#include "util.h"
+
+// entry layout - a snapshot has the top bit set and its snapshot index
+// below. A delta has the parent id in bits 16..62 and the move below.
+#define DELTA_SNAPSHOT    ( 1ULL << 63 )
+#define DELTA_PARENT_MAX  ( ( 1ULL << 47 ) - 1 )
+
+static uint64_t delta_entry( uint64_t parent, MovePacked mov ) {
+    return ( parent << 16 ) | mov.f.action | ( mov.f.source << 4 ) | ( mov.f.target << 10 );
+}
+
+static MovePacked delta_move( uint64_t entry ) {
+    return MovePacked( MoveAction( entry & 0x0f ), ( entry >> 4 ) & 0x3f, ( entry >> 10 ) & 0x3f );
+}
+
+static uint64_t page_round( uint64_t off ) {
+    return ( off + DELTASTORE_PAGE - 1 ) & ~uint64_t( DELTASTORE_PAGE - 1 );
+}
+
+DeltaStore::DeltaStore()
+: _fd(-1), _map(nullptr), _map_size(0), _cnt(0), _entries(nullptr)
+, _snap_cnt(0), _snaps(nullptr), _max_chain(0)
+{}
+
+DeltaStore::~DeltaStore() {
+    close();
+}
+
+bool DeltaStore::open( const std::string& path ) {
+    close();
+    _fd = ::open( path.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        return false;
+
+    struct stat st;
+    if ( fstat( _fd, &st ) != 0 || size_t(st.st_size) < sizeof(DeltaStoreHeader) ) {
+        close();
+        return false;
+    }
+    _map_size = st.st_size;
+    void *map = mmap( nullptr, _map_size, PROT_READ, MAP_SHARED, _fd, 0 );
+    if ( map == MAP_FAILED ) {
+        _map_size = 0;
+        close();
+        return false;
+    }
+    _map = static_cast<uint8_t *>(map);
+
+    const DeltaStoreHeader *hdr = reinterpret_cast<const DeltaStoreHeader *>(_map);
+    if ( std::memcmp( hdr->magic, DELTASTORE_MAGIC, sizeof(hdr->magic) ) != 0
+      || hdr->version != DELTASTORE_VERSION
+      || hdr->max_chain > DELTASTORE_CHAIN_MAX
+      || hdr->record_off + hdr->record_cnt * sizeof(uint64_t) > _map_size
+      || hdr->snapshot_off + hdr->snapshot_cnt * sizeof(BoardPacked) > _map_size ) {
+        close();
+        return false;
+    }
+    _cnt       = hdr->record_cnt;
+    _entries   = reinterpret_cast<const uint64_t *>( _map + hdr->record_off );
+    _snap_cnt  = hdr->snapshot_cnt;
+    _snaps     = reinterpret_cast<const BoardPacked *>( _map + hdr->snapshot_off );
+    _max_chain = hdr->max_chain;
+    return true;
+}
+
+void DeltaStore::close() {
+    if ( _map )
+        munmap( _map, _map_size );
+    if ( _fd >= 0 )
+        ::close(_fd);
+    _fd        = -1;
+    _map       = nullptr;
+    _map_size  = 0;
+    _cnt       = 0;
+    _entries   = nullptr;
+    _snap_cnt  = 0;
+    _snaps     = nullptr;
+    _max_chain = 0;
+}
+
+bool     DeltaStore::is_open() const      { return _map != nullptr; }
+uint64_t DeltaStore::size() const         { return _cnt; }
+uint64_t DeltaStore::snapshot_cnt() const { return _snap_cnt; }
+int      DeltaStore::max_chain() const    { return _max_chain; }
+
+bool DeltaStore::is_snapshot( uint64_t id ) const {
+    return _entries[id] & DELTA_SNAPSHOT;
+}
+
+uint64_t DeltaStore::parent( uint64_t id ) const {
+    return ( _entries[id] & ~DELTA_SNAPSHOT ) >> 16;
+}
+
+MovePacked DeltaStore::move( uint64_t id ) const {
+    return delta_move( _entries[id] );
+}
+
+bool DeltaStore::rebuild( uint64_t id, Board& b ) const {
+    // gather the moves back to the snapshot, then replay them forward
+    MovePacked moves[DELTASTORE_CHAIN_MAX];
+    int        cnt(0);
+    if ( id >= _cnt )
+        return false;
+    uint64_t entry = _entries[id];
+    while ( !( entry & DELTA_SNAPSHOT ) ) {
+        uint64_t parent = entry >> 16;
+        if ( cnt == _max_chain || parent >= id )
+            return false;
+        moves[cnt++] = delta_move(entry);
+        id    = parent;
+        entry = _entries[id];
+    }
+    uint64_t snap = entry & ~DELTA_SNAPSHOT;
+    if ( snap >= _snap_cnt )
+        return false;
+    b.unpack( _snaps[snap] );
+    MoveUndo undo;
+    while ( cnt )
+        b.make_move( moves[--cnt], undo );
+    return true;
+}
+
+DeltaStoreWriter::DeltaStoreWriter()
+: _fd(-1), _snap_fd(-1), _max_chain(DELTASTORE_CHAIN), _ok(false), _snap_cnt(0)
+{}
+
+DeltaStoreWriter::~DeltaStoreWriter() {
+    if ( _fd >= 0 )
+        ::close(_fd);
+    if ( _snap_fd >= 0 )
+        ::close(_snap_fd);
+}
+
+bool DeltaStoreWriter::open( const std::string& path, int max_chain ) {
+    if ( _fd >= 0 )
+        close();
+    _fd = ::open( path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644 );
+    if ( _fd < 0 )
+        return false;
+    // snapshots wait in a temporary beside the store until close()
+    std::string tmp = path + ".snap-XXXXXX";
+    _snap_fd = mkstemp( &tmp[0] );
+    if ( _snap_fd < 0 ) {
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    unlink( tmp.c_str() );
+
+    _max_chain = std::max( 0, std::min( max_chain, DELTASTORE_CHAIN_MAX ) );
+    _ok        = lseek( _fd, DELTASTORE_PAGE, SEEK_SET ) == DELTASTORE_PAGE;
+    _snap_cnt  = 0;
+    _chain.clear();
+    _buf.clear();
+    _buf.reserve( 1 << 16 );
+    _snap_buf.clear();
+    _snap_buf.reserve( 1 << 14 );
+    return _ok;
+}
+
+int64_t DeltaStoreWriter::add( const BoardPacked& rec ) {
+    if ( !_ok )
+        return -1;
+    _snap_buf.push_back(rec);
+    _buf.push_back( DELTA_SNAPSHOT | _snap_cnt++ );
+    _chain.push_back(0);
+    if ( ( _snap_buf.size() == _snap_buf.capacity() || _buf.size() == _buf.capacity() ) && !flush() )
+        return -1;
+    return _chain.size() - 1;
+}
+
+int64_t DeltaStoreWriter::add( uint64_t parent, MovePacked mov, const Board& child ) {
+    if ( !_ok || parent >= _chain.size() )
+        return -1;
+    if ( _chain[parent] >= _max_chain || parent > DELTA_PARENT_MAX )
+        return add( child.pack() );
+    _buf.push_back( delta_entry( parent, mov ) );
+    _chain.push_back( _chain[parent] + 1 );
+    if ( _buf.size() == _buf.capacity() && !flush() )
+        return -1;
+    return _chain.size() - 1;
+}
+
+bool DeltaStoreWriter::flush() {
+    _ok = _ok && write_all( _fd, _buf.data(), _buf.size() * sizeof(uint64_t) )
+              && write_all( _snap_fd, _snap_buf.data(), _snap_buf.size() * sizeof(BoardPacked) );
+    _buf.clear();
+    _snap_buf.clear();
+    return _ok;
+}
+
+bool DeltaStoreWriter::close() {
+    if ( _fd < 0 )
+        return false;
+    flush();
+
+    DeltaStoreHeader hdr;
+    std::memset( &hdr, 0, sizeof(hdr) );
+    std::memcpy( hdr.magic, DELTASTORE_MAGIC, sizeof(hdr.magic) );
+    hdr.version      = DELTASTORE_VERSION;
+    hdr.max_chain    = _max_chain;
+    hdr.record_cnt   = _chain.size();
+    hdr.record_off   = DELTASTORE_PAGE;
+    hdr.snapshot_cnt = _snap_cnt;
+    hdr.snapshot_off = page_round( DELTASTORE_PAGE + hdr.record_cnt * sizeof(uint64_t) );
+
+    // copy the snapshots over from the temporary
+    _ok = _ok && lseek( _fd, hdr.snapshot_off, SEEK_SET ) == off_t(hdr.snapshot_off);
+    std::vector<uint8_t> buf( 1 << 20 );
+    for ( off_t off(0); _ok; ) {
+        ssize_t n = pread( _snap_fd, buf.data(), buf.size(), off );
+        if ( n < 0 )
+            _ok = false;
+        if ( n <= 0 )
+            break;
+        _ok  = write_all( _fd, buf.data(), n );
+        off += n;
+    }
+    // an empty store still has its (empty) entry page
+    if ( _ok && _snap_cnt == 0 )
+        _ok = ftruncate( _fd, hdr.snapshot_off ) == 0;
+    _ok = _ok && pwrite( _fd, &hdr, sizeof(hdr), 0 ) == sizeof(hdr);
+    _ok = ( ::close(_fd) == 0 ) && _ok;
+    ::close(_snap_fd);
+    _fd      = -1;
+    _snap_fd = -1;
+    _chain.clear();
+    _chain.shrink_to_fit();
+    return _ok;
+}
+
+uint64_t DeltaStoreWriter::count() const        { return _chain.size(); }
+uint64_t DeltaStoreWriter::snapshot_cnt() const { return _snap_cnt; }
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#include "enumerate.h"
+#include "move.h"
+#include "packfilter.h"
+#include "packsort.h"
+#include "packstore.h"
+
+typedef std::chrono::steady_clock Clock;
+
+std::string enumerate_level_path( const std::string& dir, int ply ) {
+    char name[32];
+    std::snprintf( name, sizeof(name), "/level-%02d.pks", ply );
+    return dir + name;
+}
+
+// an earlier level's store, with a filter over its records
+struct SeenLevel {
+    PackStore  store;
+    PackFilter filter;
+
+    SeenLevel( uint64_t cnt, double fp_rate ) : filter( cnt, fp_rate ) {}
+};
+typedef std::vector<std::unique_ptr<SeenLevel>> SeenLevels;
+
+static bool already_seen( const BoardPacked& rec, const SeenLevels& seen ) {
+    for ( auto& lvl : seen )
+        if ( lvl->filter.maybe_contains(rec) && lvl->store.contains(rec) )
+            return true;
+    return false;
+}
+
+// expand parents[0..cnt) into packed children, handing them to the sorter
+// less any found at an earlier level
+static bool expand_chunk( const BoardPacked *parents, size_t cnt, bool identity, const SeenLevels& seen,
+                          PackSorter& sorter,
+                          std::atomic<uint64_t>& children, std::atomic<uint64_t>& dropped ) {
+    std::vector<Board> boards( cnt, Board(false) );
+    Board::unpack_many( parents, boards.data(), cnt );
+
+    std::vector<BoardPacked> out;
+    out.reserve( cnt * 40 );
+    MoveArray moves;
+    uint64_t  made(0);
+    for ( auto& b : boards ) {
+        moves.clear();
+        b.get_legal_moves(moves);
+        for ( auto mov : moves ) {
+            MoveUndo undo;
+            b.make_move( mov, undo );
+            BoardPacked rec = ( identity ) ? b.pack_identity() : b.pack();
+            b.unmake_move( mov, undo );
+            made++;
+            if ( !already_seen( rec, seen ) )
+                out.push_back(rec);
+        }
+    }
+
+    children += made;
+    dropped  += made - out.size();
+    return sorter.add( out.data(), out.size() );
+}
+
+bool enumerate_positions( const Board& root, ThreadPool& pool,
+                          const EnumerateOptions& opt, const LevelReport& report ) {
+    auto start = Clock::now();
+    {
+        PackStoreWriter w;
+        if ( !w.open( enumerate_level_path( opt.dir, 0 ) )
+          || !w.add( ( opt.identity ) ? root.pack_identity() : root.pack() )
+          || !w.close() )
+            return false;
+    }
+    // levels that could hold a child of the next ply, most recent first
+    SeenLevels seen_odd, seen_even;
+    auto add_seen = [&]( int ply ) {
+        auto lvl = std::make_unique<SeenLevel>( 0, opt.filter_fp );
+        if ( !lvl->store.open( enumerate_level_path( opt.dir, ply ) ) )
+            return false;
+        lvl->filter = PackFilter( lvl->store.size(), opt.filter_fp );
+        for ( auto& rec : lvl->store )
+            lvl->filter.insert(rec);
+        SeenLevels& seen = ( ply & 1 ) ? seen_odd : seen_even;
+        seen.insert( seen.begin(), std::move(lvl) );
+        return true;
+    };
+    if ( report )
+        report( EnumerateLevel{ 0, 0, 0, 0, 1,
+                std::chrono::duration<double>( Clock::now() - start ).count(),
+                enumerate_level_path( opt.dir, 0 ) } );
+    if ( opt.first_seen && opt.depth >= 2 && !add_seen(0) )
+        return false;
+
+    for ( int ply(1); ply <= opt.depth; ++ply ) {
+        start = Clock::now();
+        PackStore parents;
+        if ( !parents.open( enumerate_level_path( opt.dir, ply - 1 ) ) )
+            return false;
+        if ( parents.size() == 0 )
+            break;  // nothing left to move - every line ended in mate or stalemate
+
+        PackSorter            sorter( opt.ram_mb, opt.dir );
+        std::atomic<uint64_t> children(0);
+        std::atomic<uint64_t> dropped(0);
+        std::atomic<bool>     ok(true);
+        size_t                chunk = std::max<size_t>( opt.chunk, 1 );
+        const SeenLevels&     seen  = ( ply & 1 ) ? seen_odd : seen_even;
+        {
+            TaskGroup grp(pool);
+            for ( uint64_t idx(0); idx < parents.size(); idx += chunk ) {
+                const BoardPacked *first = parents.begin() + idx;
+                size_t             cnt   = std::min<uint64_t>( chunk, parents.size() - idx );
+                grp.run( [&, first, cnt]{
+                    if ( ok && !expand_chunk( first, cnt, opt.identity, seen, sorter, children, dropped ) )
+                        ok = false;
+                } );
+            }
+            grp.wait();
+        }
+        if ( !ok )
+            return false;
+
+        EnumerateLevel lvl;
+        lvl.ply      = ply;
+        lvl.parents  = parents.size();
+        lvl.children = children;
+        lvl.seen     = dropped;
+        lvl.path     = enumerate_level_path( opt.dir, ply );
+        PackStoreWriter w;
+        if ( !w.open( lvl.path ) || !sorter.finish(w) || !w.close() )
+            return false;
+        lvl.unique = sorter.emitted();
+        lvl.secs   = std::chrono::duration<double>( Clock::now() - start ).count();
+        if ( report )
+            report(lvl);
+        if ( opt.first_seen && ply + 2 <= opt.depth && !add_seen(ply) )
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,270 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "epd.h"
+#include "util.h"
+
+EpdFile::EpdFile()
+: _fd(-1), _map(nullptr), _size(0), _next(nullptr), _next_line(1)
+{}
+
+EpdFile::~EpdFile() {
+    close();
+}
+
+bool EpdFile::open( const std::string& path ) {
+    close();
+    _fd = ::open( path.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        return false;
+    struct stat st;
+    if ( fstat( _fd, &st ) != 0 ) {
+        close();
+        return false;
+    }
+    _size = st.st_size;
+    if ( _size == 0 )
+        return true;    // nothing to map, and nothing to load
+    void *map = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+    if ( map == MAP_FAILED ) {
+        close();
+        return false;
+    }
+    _map = static_cast<const char *>(map);
+    rewind();
+    // each chunk is read front to back, once
+    madvise( const_cast<char *>(_map), _size, MADV_SEQUENTIAL );
+    return true;
+}
+
+void EpdFile::close() {
+    if ( _map )
+        munmap( const_cast<char *>(_map), _size );
+    if ( _fd >= 0 )
+        ::close(_fd);
+    _fd        = -1;
+    _map       = nullptr;
+    _size      = 0;
+    _next      = nullptr;
+    _next_line = 1;
+}
+
+void EpdFile::rewind() {
+    _next      = _map;
+    _next_line = 1;
+}
+
+bool   EpdFile::is_open() const { return _fd >= 0; }
+size_t EpdFile::bytes() const   { return _size; }
+
+// true if the line holds a position, rather than being blank or a comment
+static bool is_position( const char *p, const char *end ) {
+    while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' ) )
+        ++p;
+    return p < end && *p != '#';
+}
+
+// call fn( line, line_end ) for each line of [beg, end)
+template <class Fn>
+static void for_each_line( const char *beg, const char *end, Fn fn ) {
+    while ( beg < end ) {
+        const char *nl = static_cast<const char *>( std::memchr( beg, '\n', end - beg ) );
+        if ( !nl )
+            nl = end;
+        fn( beg, nl );
+        beg = nl + 1;
+    }
+}
+
+// Cut [beg, end) into chunks ending on line boundaries, then count each
+// chunk's lines and positions in parallel so every chunk knows its
+// first line number and where its positions go in the output.
+std::vector<EpdFile::Chunk> EpdFile::chunks( ThreadPool& pool, const char *beg, const char *end,
+                                            uint64_t line ) const {
+    std::vector<Chunk> chs;
+    for ( const char *p = beg; p < end; ) {
+        const char *stop = p + std::min<size_t>( EPD_CHUNK, end - p );
+        if ( stop < end ) {
+            const char *nl = static_cast<const char *>( std::memchr( stop, '\n', end - stop ) );
+            stop = ( nl ) ? nl + 1 : end;
+        }
+        chs.push_back( Chunk{ p, stop, 0, 0, 0, {} } );
+        p = stop;
+    }
+
+    std::vector<uint64_t> lines( chs.size() );
+    {
+        TaskGroup grp(pool);
+        for ( size_t idx(0); idx < chs.size(); ++idx )
+            grp.run( [&, idx]{
+                for_each_line( chs[idx].beg, chs[idx].end, [&]( const char *p, const char *nl ) {
+                    lines[idx]++;
+                    chs[idx].cnt += is_position( p, nl );
+                } );
+            } );
+        grp.wait();
+    }
+    uint64_t first(0);
+    for ( size_t idx(0); idx < chs.size(); ++idx ) {
+        chs[idx].line  = line;
+        chs[idx].first = first;
+        line  += lines[idx];
+        first += chs[idx].cnt;
+    }
+    return chs;
+}
+
+// Parse each chunk into its own stretch of out, then close up the gaps
+// left by malformed lines. parse( line, out_slot, err ) returns false,
+// with err set, for a malformed line. blank fills the slots beforehand.
+template <class T, class Parse>
+uint64_t EpdFile::load_into( ThreadPool& pool, std::vector<T>& out, const T& blank, EpdErrorList *errs,
+                             const char *beg, const char *end, uint64_t line, Parse parse ) const {
+    std::vector<Chunk> chs = chunks( pool, beg, end, line );
+    uint64_t total = ( chs.empty() ) ? 0 : chs.back().first + chs.back().cnt;
+    out.resize( total, blank );
+    {
+        TaskGroup grp(pool);
+        for ( auto& ch : chs )
+            grp.run( [&]{
+                uint64_t line = ch.line;
+                uint64_t pos  = ch.first;
+                for_each_line( ch.beg, ch.end, [&]( const char *p, const char *nl ) {
+                    if ( is_position( p, nl ) ) {
+                        FenError err;
+                        if ( parse( std::string_view( p, nl - p ), out[pos], err ) )
+                            pos++;
+                        else if ( errs )
+                            ch.errs.push_back( EpdError{ line, err.pos + 1, err.msg } );
+                    }
+                    line++;
+                } );
+                ch.cnt = pos - ch.first;
+            } );
+        grp.wait();
+    }
+
+    uint64_t cnt(0);
+    for ( auto& ch : chs ) {
+        if ( cnt != ch.first )
+            std::move( out.begin() + ch.first, out.begin() + ch.first + ch.cnt, out.begin() + cnt );
+        cnt += ch.cnt;
+        if ( errs )
+            errs->insert( errs->end(), ch.errs.begin(), ch.errs.end() );
+    }
+    out.resize( cnt, blank );
+    return cnt;
+}
+
+uint64_t EpdFile::load( ThreadPool& pool, std::vector<Board>& boards, EpdErrorList *errs ) const {
+    if ( errs )
+        errs->clear();
+    boards.clear();
+    return load_into( pool, boards, Board(false), errs, _map, _map + _size, 1, []( std::string_view line, Board& b, FenError& err ) {
+        return b.parse_fen( line, &err );
+    } );
+}
+
+// parse a line into rec, packed as asked
+static bool parse_packed( std::string_view line, BoardPacked& rec, FenError& err, bool identity ) {
+    thread_local Board b(false);
+    if ( !b.parse_fen( line, &err ) )
+        return false;
+    rec = ( identity ) ? b.pack_identity() : b.pack();
+    return true;
+}
+
+uint64_t EpdFile::load( ThreadPool& pool, BoardPackedList& packs, EpdErrorList *errs, bool identity ) const {
+    if ( errs )
+        errs->clear();
+    packs.clear();
+    return load_into( pool, packs, BoardPacked(), errs, _map, _map + _size, 1,
+        [identity]( std::string_view line, BoardPacked& rec, FenError& err ) {
+            return parse_packed( line, rec, err, identity );
+        } );
+}
+
+bool EpdFile::load_next( ThreadPool& pool, BoardPackedList& packs, size_t bytes,
+                         EpdErrorList *errs, bool identity ) {
+    if ( errs )
+        errs->clear();
+    packs.clear();
+    const char *end = _map + _size;
+    if ( _next == end )
+        return false;
+    const char *stop = _next + std::min<size_t>( std::max<size_t>( bytes, 1 ), end - _next );
+    if ( stop < end ) {
+        const char *nl = static_cast<const char *>( std::memchr( stop, '\n', end - stop ) );
+        stop = ( nl ) ? nl + 1 : end;
+    }
+    load_into( pool, packs, BoardPacked(), errs, _next, stop, _next_line,
+        [identity]( std::string_view line, BoardPacked& rec, FenError& err ) {
+            return parse_packed( line, rec, err, identity );
+        } );
+    _next_line += std::count( _next, stop, '\n' );
+    _next       = stop;
+    return true;
+}
+
+bool write_fens( int fd, const BoardPacked *recs, size_t cnt ) {
+    const size_t       batch = 1024;
+    std::vector<Board> boards( std::min( cnt, batch ), Board(false) );
+    std::vector<char>  buf( EPD_CHUNK );
+    char              *p = buf.data();
+    char              *lim = buf.data() + buf.size() - FEN_MAX;
+    for ( size_t idx(0); idx < cnt; idx += batch ) {
+        size_t n = std::min( batch, cnt - idx );
+        Board::unpack_many( recs + idx, boards.data(), n );
+        for ( size_t b(0); b < n; ++b ) {
+            if ( p > lim ) {
+                if ( !write_all( fd, buf.data(), p - buf.data() ) )
+                    return false;
+                p = buf.data();
+            }
+            p    = boards[b].fen_to(p);
+            *p++ = '\n';
+        }
+    }
+    return write_all( fd, buf.data(), p - buf.data() );
+}
+
+bool write_fens( ThreadPool& pool, int fd, const BoardPacked *recs, size_t cnt ) {
+    // enough tasks to keep the pool busy, each writing to its own buffer
+    const size_t per  = EPD_CHUNK / FEN_MAX;
+    const size_t span = per * std::max<size_t>( 2 * pool.size(), 1 );
+    std::vector<std::vector<char>> bufs;
+    std::vector<size_t>            lens;
+    for ( size_t idx(0); idx < cnt; idx += span ) {
+        size_t n     = std::min( span, cnt - idx );
+        size_t tasks = ( n + per - 1 ) / per;
+        bufs.resize( std::max( bufs.size(), tasks ) );
+        lens.assign( tasks, 0 );
+        {
+            TaskGroup grp(pool);
+            for ( size_t t(0); t < tasks; ++t )
+                grp.run( [&, t]{
+                    size_t first = idx + t * per;
+                    size_t last  = std::min( first + per, idx + n );
+                    bufs[t].resize( per * FEN_MAX );
+                    char *p = bufs[t].data();
+                    Board b(false);
+                    for ( size_t r(first); r < last; ++r ) {
+                        b.unpack( recs[r] );
+                        p    = b.fen_to(p);
+                        *p++ = '\n';
+                    }
+                    lens[t] = p - bufs[t].data();
+                } );
+            grp.wait();
+        }
+        for ( size_t t(0); t < tasks; ++t )
+            if ( !write_all( fd, bufs[t].data(), lens[t] ) )
+                return false;
+    }
+    return true;
+}
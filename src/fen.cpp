@@ -1,16 +1,60 @@
 
-#include <sstream>
+#include <algorithm>
 
 #include "board.h"
 
+// Piece::byte() of each FEN piece letter, 0 for any other character
+struct FenBytes {
+    uint8_t by[128];
+
+    constexpr FenBytes() : by() {
+        const char *glyphs = ".KQBNRP";
+        for ( int pt(PT_KING); pt <= PT_PAWN; ++pt ) {
+            by[ int(glyphs[pt])      ] = uint8_t( pt );
+            by[ int(glyphs[pt]) + 32 ] = uint8_t( pt | 0x08 );  // lower case is black
+        }
+    }
+};
+static constexpr FenBytes fen_bytes;
+
 // Initialize a board from Forsyth-Edwards (FEN) notation string.
-//
-// 
+// Malformed input is not reported - see parse_fen().
 void Board::from_fen(const std::string& fen)
 {
-    _pm.clear();
+    parse_fen(fen);
+}
+
+// Parse a FEN (or the first four fields of an EPD line) straight from
+// the text, without copying or splitting it. Returns false at the first
+// malformed field, setting err (if given) to where and why; the board is
+// then left in an unspecified state.
+//
+// The halfmove clock and fullmove count may be left off (as EPD does),
+// defaulting to 0 and 1. Anything after the fields - EPD operations, a
+// comment - is ignored.
+bool Board::parse_fen(std::string_view fen, FenError *err)
+{
+    const char *beg = fen.data();
+    const char *end = beg + fen.size();
+    const char *p   = beg;
+    auto fail = [&]( const char *msg ) {
+        if ( err ) {
+            err->pos = p - beg;
+            err->msg = msg;
+        }
+        return false;
+    };
+    auto skip_space = [&]() {
+        while ( p < end && ( *p == ' ' || *p == '\t' ) )
+            ++p;
+    };
+    auto at_field_end = [&]() {
+        return p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n';
+    };
+
+    clear();
+    skip_space();
 
-    std::vector<std::string> toks = split(fen, " ");
     // Field 1 - Piece Placement Data
     //
     // - Each rank is described, starting with rank 8 and ending with rank 1,
@@ -24,38 +68,65 @@ void Board::from_fen(const std::string& fen)
     // - A set of one or more consecutive empty squares within a rank is denoted
     //   by a digit from "1" to "8", corresponding to the number of squares.
     //
-    short rank(R8);
-    short file(Fa);
-    for (const char *p = toks[0].c_str(); *p; ++p ) {
-        if ( std::isalpha(*p) ) {
-            // piece type
-            PieceType pt;
-            Side      side = (std::islower(*p)?SIDE_BLACK:SIDE_WHITE);
-            switch(std::toupper(*p)) {
-                case 'K': pt = PT_KING;   break;
-                case 'Q': pt = PT_QUEEN;  break;
-                case 'B': pt = PT_BISHOP; break;
-                case 'N': pt = PT_KNIGHT; break;
-                case 'R': pt = PT_ROOK;   break;
-                case 'P': pt = PT_PAWN;   break;
-            }
-            set(Square(rank, file++), pt, side);
-        } else if ( std::isdigit(*p) ) {
+    int rank(R8);
+    int file(Fa);
+    int cnt(0);
+    for ( ; !at_field_end(); ++p ) {
+        unsigned char ch = *p;
+        if ( ch >= '1' && ch <= '8' ) {
             // count of empty squares
-            file += short( *p - '0' );
-        } else if ( *p == '/' ) {
+            file += ch - '0';
+            if ( file > 8 )
+                return fail( "rank has more than 8 squares" );
+        } else if ( ch == '/' ) {
             // end of rank
+            if ( file != 8 )
+                return fail( "rank has fewer than 8 squares" );
+            if ( rank == R1 )
+                return fail( "more than 8 ranks" );
             --rank;
-            file=Fa;
+            file = Fa;
+        } else if ( ch < 128 && fen_bytes.by[ch] ) {
+            // piece
+            if ( file > Fh )
+                return fail( "rank has more than 8 squares" );
+            if ( ++cnt > 32 )
+                return fail( "more than 32 pieces" );
+            put_byte( RNF(rank, file), fen_bytes.by[ch] );
+            file++;
         } else {
-            // error! unknown char
+            return fail( "unknown character in piece placement" );
         }
     }
+    if ( rank != R1 || file != 8 )
+        return fail( "piece placement is not 8 full ranks" );
+    // material no game can reach could also outgrow a MoveArray
+    for ( Side s : { SIDE_WHITE, SIDE_BLACK } ) {
+        Bitboard side  = side_bb(s);
+        int      pawns = bb_count( side & ( type_bb(PT_PAWN) | type_bb(PT_PAWN_OFF) ) );
+        int      extra = std::max( bb_count( side & type_bb(PT_QUEEN) )  - 1, 0 )
+                       + std::max( bb_count( side & type_bb(PT_ROOK) )   - 2, 0 )
+                       + std::max( bb_count( side & type_bb(PT_BISHOP) ) - 2, 0 )
+                       + std::max( bb_count( side & type_bb(PT_KNIGHT) ) - 2, 0 );
+        if ( bb_count(side) > 16 )
+            return fail( "more than 16 pieces for one side" );
+        if ( bb_count( side & type_bb(PT_KING) ) > 1 )
+            return fail( "more than one king for one side" );
+        if ( pawns > 8 )
+            return fail( "more than 8 pawns for one side" );
+        if ( extra > 8 - pawns )
+            return fail( "more promoted pieces than missing pawns" );
+    }
 
     // Field 2 - Active Color
     // - "w" means that White is to move; "b" means that Black is to move
     //
-    _on_move = ( std::tolower(toks[1].at(0)) == 'b' ) ? SIDE_BLACK : SIDE_WHITE;
+    skip_space();
+    if ( p == end || ( *p != 'w' && *p != 'b' ) )
+        return fail( "active color is not w or b" );
+    _on_move = ( *p++ == 'b' ) ? SIDE_BLACK : SIDE_WHITE;
+    if ( !at_field_end() )
+        return fail( "active color is not w or b" );
 
     // Field 3 - Castling Availability
     // - If neither side has the ability to castle, this field uses the 
@@ -68,23 +139,25 @@ void Board::from_fen(const std::string& fen)
     // - A situation that temporarily prevents castling does not prevent
     //    the use of this notation.
     //
-    if ( toks[2] == "-" ) {
-        _castle_black_kingside =
-        _castle_black_queenside =
-        _castle_white_kingside =
-        _castle_white_queenside = false;
+    skip_space();
+    if ( p < end && *p == '-' ) {
+        ++p;
     } else {
-        const char *p = toks[2].c_str();
-        while ( *p )
-        {
-            switch( *p++ ) {
+        const char *first = p;
+        for ( ; !at_field_end(); ++p ) {
+            switch( *p ) {
             case 'K': _castle_white_kingside  = true; break;    
             case 'Q': _castle_white_queenside = true; break;    
             case 'k': _castle_black_kingside  = true; break;    
             case 'q': _castle_black_queenside = true; break;    
+            default:  return fail( "unknown character in castling rights" );
             }
         }
+        if ( p == first )
+            return fail( "missing castling rights" );
     }
+    if ( !at_field_end() )
+        return fail( "unknown character in castling rights" );
 
     // Field 4 - En Passant target square
     // - This is a square over which a pawn has just passed while moving two
@@ -94,26 +167,72 @@ void Board::from_fen(const std::string& fen)
     // -  This is recorded regardless of whether there is a pawn in position to
     //    capture en passant.
     //
-    if ( toks[3] == "-" ) {
-        _en_passant = Square::UNBOUNDED;
+    skip_space();
+    if ( p < end && *p == '-' ) {
+        ++p;
+    } else if ( end - p >= 2 && p[0] >= 'a' && p[0] <= 'h' && ( p[1] == '3' || p[1] == '6' ) ) {
+        _en_passant = Square( Rank( p[1] - '1' ), File( p[0] - 'a' ) );
+        p += 2;
     } else {
-        _en_passant = Square(toks[3]);
+        return fail( "en passant square is not - or on rank 3 or 6" );
     }
+    if ( !at_field_end() )
+        return fail( "en passant square is not - or on rank 3 or 6" );
 
     // Field 5 - Halfmove Clock
     // - The number of halfmoves since the last capture or pawn advance, used for 
     //   the fifty-move rule.
     //
-    _half_move_clock = std::stoi(toks[4]);
-
     // Field 6 - Fullmove Count
     // - The number of the full moves. It starts at 1 and is incremented after
     //   Black's move.
     //
-    _full_move_cnt = std::stoi(toks[5]);
+    // Either both are given or neither - a field that isn't a number is
+    // taken as the start of the EPD operations.
+    _half_move_clock = 0;
+    _full_move_cnt   = 1;
+    skip_space();
+    if ( p < end && *p >= '0' && *p <= '9' ) {
+        short clocks[2];
+        for ( auto& clk : clocks ) {
+            skip_space();
+            int val(0);
+            const char *first = p;
+            while ( p < end && *p >= '0' && *p <= '9' && val < 0x7fff )
+                val = val * 10 + ( *p++ - '0' );
+            if ( p == first || !at_field_end() || val > 0x7fff )
+                return fail( "halfmove clock or fullmove count is not a number" );
+            clk = short(val);
+        }
+        _half_move_clock = clocks[0];
+        _full_move_cnt   = clocks[1];
+    }
+
+    _key = compute_key();
+    return true;
 }
 
-std::string Board::fen()
+// write val in decimal, returning the end
+static char *put_num( char *p, int val ) {
+    if ( val < 0 ) {
+        *p++ = '-';
+        val  = -val;
+    }
+    char  tmp[8];
+    char *t = tmp;
+    do {
+        *t++ = char( '0' + val % 10 );
+        val /= 10;
+    } while ( val );
+    while ( t > tmp )
+        *p++ = *--t;
+    return p;
+}
+
+// Write the FEN for the board into buf, which must have room for FEN_MAX
+// chars. The FEN is NUL terminated, and the returned pointer is to that
+// NUL, so that further text can be appended.
+char *Board::fen_to(char *buf) const
 {
     // Field 1 - Piece Placement Data
     //
@@ -128,34 +247,31 @@ std::string Board::fen()
     // - A set of one or more consecutive empty squares within a rank is denoted
     //   by a digit from "1" to "8", corresponding to the number of squares.
     //
-    std::string fen;
-    std::stringstream ss;
-    for ( short rank = R8; rank >= R1; --rank ) {
-        short cnt(0);
-        for ( short file = Fa; file <= Fh; ++file ) {
-            PiecePtr ptr = at((Rank)rank,(File)file);
-            if ( ptr->is_empty() ) {
+    char *p = buf;
+    for ( int rank = R8; rank >= R1; --rank ) {
+        char cnt('0');
+        for ( int file = Fa; file <= Fh; ++file ) {
+            uint8_t by = _mailbox[ RNF( rank, file ) ];
+            if ( by == 0 ) {
                 cnt++;
             } else {
-                if ( cnt ) {
-                    ss << cnt;
-                    cnt = 0;
+                if ( cnt != '0' ) {
+                    *p++ = cnt;
+                    cnt  = '0';
                 }
-                ss << ptr->glyph();
+                *p++ = byte_glyph(by);
             }
         }
-        if ( cnt )
-            ss << cnt;
-        if ( rank > R1 )
-            ss << '/';
+        if ( cnt != '0' )
+            *p++ = cnt;
+        *p++ = ( rank > R1 ) ? '/' : ' ';
     }
-    ss << ' ';
 
     // Field 2 - Active Color
     // - "w" means that White is to move; "b" means that Black is to move
     //
-    ss << (IS_BLACK( _on_move ) ? 'b' : 'w')
-       << ' ';
+    *p++ = IS_BLACK( _on_move ) ? 'b' : 'w';
+    *p++ = ' ';
 
     // Field 3 - Castling Availability
     // - If neither side has the ability to castle, this field uses the 
@@ -171,14 +287,14 @@ std::string Board::fen()
     if ( !_castle_white_kingside && !_castle_white_queenside
       && !_castle_black_kingside && !_castle_black_queenside
     ) {
-        ss << '-';
+        *p++ = '-';
     } else {
-        if ( _castle_white_kingside  ) ss << 'K';
-        if ( _castle_white_queenside ) ss << 'Q';
-        if ( _castle_black_kingside  ) ss << 'k';
-        if ( _castle_black_queenside ) ss << 'q';
+        if ( _castle_white_kingside  ) *p++ = 'K';
+        if ( _castle_white_queenside ) *p++ = 'Q';
+        if ( _castle_black_kingside  ) *p++ = 'k';
+        if ( _castle_black_queenside ) *p++ = 'q';
     }
-    ss << ' ' ;
+    *p++ = ' ';
 
     // Field 4 - En Passant target square
     // - This is a square over which a pawn has just passed while moving two
@@ -189,23 +305,31 @@ std::string Board::fen()
     //    capture en passant.
     //
     if ( _en_passant == Square::UNBOUNDED ) {
-        ss << '-';
+        *p++ = '-';
     } else {
-        ss << _en_passant;
+        *p++ = char( 'a' + _en_passant.file() );
+        *p++ = char( '1' + _en_passant.rank() );
     }
-    ss << ' ';
+    *p++ = ' ';
 
     // Field 5 - Halfmove Clock
     // - The number of halfmoves since the last capture or pawn advance, used for 
     //   the fifty-move rule.
     //
-    ss << _half_move_clock << ' ';
+    p    = put_num( p, _half_move_clock );
+    *p++ = ' ';
 
     // Field 6 - Fullmove Count
     // - The number of the full moves. It starts at 1 and is incremented after
     //   Black's move.
     //
-    ss << _full_move_cnt;
+    p  = put_num( p, _full_move_cnt );
+    *p = '\0';
+    return p;
+}
 
-    return ss.str();
+std::string Board::fen() const
+{
+    char buf[FEN_MAX];
+    return std::string( buf, fen_to(buf) );
 }
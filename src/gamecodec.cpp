@@ -0,0 +1,193 @@
+#include "gamecodec.h"
+
+// Range coder bounds (a carryless range coder, after Subbotin.) Totals
+// coded must stay below RC_BOT.
+#define RC_TOP ( 1U << 24 )
+#define RC_BOT ( 1U << 16 )
+
+// model adaptation - the step added to an index each time it is coded,
+// and the total at which all the frequencies are halved
+#define MODEL_STEP  32
+#define MODEL_LIMIT 60000
+
+// the parts of a MovePacked that say which move it is - not the result
+#define MOVE_MASK 0x000fff0fU
+
+GameModel::GameModel() {
+    reset();
+}
+
+void GameModel::reset() {
+    for ( auto& f : _freq )
+        f = 1;
+    _total = GAMECODEC_SYMBOLS;
+}
+
+uint32_t GameModel::total( int n ) const {
+    uint32_t tot(0);
+    for ( int sym(0); sym < n; ++sym )
+        tot += _freq[sym];
+    return tot;
+}
+
+void GameModel::update( int sym ) {
+    _freq[sym] += MODEL_STEP;
+    _total     += MODEL_STEP;
+    if ( _total > MODEL_LIMIT ) {
+        _total = 0;
+        for ( auto& f : _freq ) {
+            f = ( f + 1 ) / 2;
+            _total += f;
+        }
+    }
+}
+
+static void put_varint( std::vector<uint8_t>& out, uint64_t val ) {
+    while ( val >= 0x80 ) {
+        out.push_back( uint8_t( val | 0x80 ) );
+        val >>= 7;
+    }
+    out.push_back( uint8_t(val) );
+}
+
+// read a varint from [p, end), false if it runs off the end
+static bool get_varint( const uint8_t *&p, const uint8_t *end, uint64_t& val ) {
+    val = 0;
+    for ( int shift(0); p < end && shift < 64; shift += 7 ) {
+        uint8_t by = *p++;
+        val |= uint64_t( by & 0x7f ) << shift;
+        if ( !( by & 0x80 ) )
+            return true;
+    }
+    return false;
+}
+
+GameEncoder::GameEncoder( GameModel& model )
+: _model(model)
+{}
+
+bool GameEncoder::encode( const Board& root, const MovePacked *moves, size_t cnt, std::vector<uint8_t>& out ) {
+    // the model adapts as the plies are coded - keep a copy to put back
+    // should a move turn out to be illegal
+    GameModel saved(_model);
+    std::vector<uint8_t> payload;
+    payload.reserve( cnt );
+    uint32_t  low(0), range(0xffffffff);
+    Board     b(root);
+    MoveArray legal;
+    MoveUndo  undo;
+    for ( size_t ply(0); ply < cnt; ++ply ) {
+        legal.clear();
+        b.get_legal_moves(legal);
+        int n   = legal.size();
+        int idx = 0;
+        while ( idx < n && ( ( legal[idx].i ^ moves[ply].i ) & MOVE_MASK ) )
+            idx++;
+        if ( idx == n || n > GAMECODEC_SYMBOLS ) {
+            _model = saved;
+            return false;
+        }
+
+        // a forced move needs no bits
+        if ( n > 1 ) {
+            uint32_t cum = _model.total(idx);
+            range /= _model.total(n);
+            low   += cum * range;
+            range *= _model._freq[idx];
+            while ( ( low ^ ( low + range ) ) < RC_TOP
+                 || ( range < RC_BOT && ( ( range = -low & ( RC_BOT - 1 ) ), true ) ) ) {
+                payload.push_back( uint8_t( low >> 24 ) );
+                low   <<= 8;
+                range <<= 8;
+            }
+            _model.update(idx);
+        }
+        b.make_move( legal[idx], undo );
+    }
+    for ( int i(0); i < 4; ++i ) {
+        payload.push_back( uint8_t( low >> 24 ) );
+        low <<= 8;
+    }
+
+    std::vector<uint8_t> hdr;
+    put_varint( hdr, cnt );
+    put_varint( out, hdr.size() + payload.size() );
+    out.insert( out.end(), hdr.begin(), hdr.end() );
+    out.insert( out.end(), payload.begin(), payload.end() );
+    return true;
+}
+
+GameDecoder::GameDecoder( GameModel& model )
+: _model(model), _board(false), _p(nullptr), _end(nullptr)
+, _plies(0), _played(0), _low(0), _range(0), _code(0)
+{}
+
+const Board& GameDecoder::board() const  { return _board; }
+size_t       GameDecoder::plies() const  { return _plies; }
+size_t       GameDecoder::played() const { return _played; }
+
+// the next payload byte - past the end reads as 0, as the encoder's
+// final flush would have written
+uint8_t GameDecoder::in() {
+    return ( _p < _end ) ? *_p++ : 0;
+}
+
+size_t GameDecoder::start( const uint8_t *data, size_t len, const Board& root ) {
+    const uint8_t *p   = data;
+    const uint8_t *end = data + len;
+    uint64_t       rec_len, plies;
+    if ( !get_varint( p, end, rec_len ) || rec_len > uint64_t( end - p ) )
+        return 0;
+    end = p + rec_len;
+    if ( !get_varint( p, end, plies ) )
+        return 0;
+
+    _board  = root;
+    _p      = p;
+    _end    = end;
+    _plies  = plies;
+    _played = 0;
+    _low    = 0;
+    _range  = 0xffffffff;
+    _code   = 0;
+    for ( int i(0); i < 4; ++i )
+        _code = ( _code << 8 ) | in();
+    return end - data;
+}
+
+bool GameDecoder::next( MovePacked& mov ) {
+    if ( _played == _plies )
+        return false;
+    MoveArray legal;
+    _board.get_legal_moves(legal);
+    int n = legal.size();
+    if ( n == 0 || n > GAMECODEC_SYMBOLS )
+        return false;
+
+    int idx(0);
+    if ( n > 1 ) {
+        uint32_t tot = _model.total(n);
+        _range /= tot;
+        uint32_t val = ( _code - _low ) / _range;
+        if ( val >= tot )
+            return false;
+        // find the index whose frequency span holds val
+        uint32_t cum(0);
+        while ( cum + _model._freq[idx] <= val )
+            cum += _model._freq[idx++];
+        _low   += cum * _range;
+        _range *= _model._freq[idx];
+        while ( ( _low ^ ( _low + _range ) ) < RC_TOP
+             || ( _range < RC_BOT && ( ( _range = -_low & ( RC_BOT - 1 ) ), true ) ) ) {
+            _code    = ( _code << 8 ) | in();
+            _low   <<= 8;
+            _range <<= 8;
+        }
+        _model.update(idx);
+    }
+    mov = legal[idx];
+    MoveUndo undo;
+    _board.make_move( mov, undo );
+    _played++;
+    return true;
+}
@@ -12,6 +12,10 @@ MovePtr Move::create(MoveAction ma, MoveResult mr, Square org, Square dst ) {
     return std::make_shared<Move>(ma, mr, org, dst);
 }
 
+MovePtr Move::create(MovePacked pack) {
+    return std::make_shared<Move>(pack);
+}
+
 MovePacked Move::pack() const {
     MovePacked ret;
     ret.i = 0;
@@ -0,0 +1,263 @@
+// allocation-free pseudo-legal and legal move generation
+#include "attacks.h"
+#include "constants.h"
+#include "move.h"
+#include "board.h"
+
+// Generate all pseudo-legal moves for the side on-move into moves. Moves
+// are produced piece by piece in square order (a1..h8), so the order is
+// deterministic for a given position.
+MoveArray& Board::get_moves(MoveArray& moves) const {
+    Side     s   = _on_move;
+    Bitboard occ = occupied();
+    Bitboard bb  = _bb_side[s];
+    while ( bb ) {
+        int       org = bb_pop(bb);
+        PieceType pt  = byte_type(_mailbox[org]);
+        switch ( pt ) {
+        case PT_PAWN:
+        case PT_PAWN_OFF:
+            gen_pawn_moves( org, s, BB_FULL, false, moves );
+            break;
+        case PT_KNIGHT:
+            push_moves( org, knight_attacks(org) & ~_bb_side[s], moves );
+            break;
+        case PT_KING:
+            push_moves( org, king_attacks(org) & ~_bb_side[s], moves );
+            gen_castle_moves( org, s, moves );
+            break;
+        default:
+            // sliding pieces get all their targets from a single table lookup
+            push_moves( org, slider_attacks( pt, org, occ ) & ~_bb_side[s], moves );
+            break;
+        }
+    }
+    return moves;
+}
+
+// Generate only the strictly legal moves for the side on-move, in the
+// same order as get_moves(), without making any of them.
+//
+// Checkers and pinned pieces are found once per position:
+// - in double check only the king may move;
+// - in single check every other piece is limited to the check mask, the
+//   checking piece plus the squares between it and the king;
+// - a pinned piece may only move along the ray between its pinner and
+//   the king, pinner included.
+// King moves are tested against attacks with the king lifted off the
+// board, so it cannot step back along a slider's line. En passant, which
+// can uncover an attack along the rank by removing two pawns at once, is
+// tested by simulating the resulting occupancy.
+MoveArray& Board::get_legal_moves(MoveArray& moves) const {
+    Side     s    = _on_move;
+    Side     them = OTHER_SIDE(s);
+    Bitboard own  = _bb_side[s];
+    Bitboard occ  = occupied();
+    Bitboard kbb  = _bb_type[PT_KING] & own;
+    if ( kbb == BB_EMPTY )
+        return get_moves(moves);    // not a real position - nothing to protect
+
+    int      ksq      = bb_lsb(kbb);
+    Bitboard checkers = attackers_to( ksq, them, occ );
+    Bitboard mask     = BB_FULL;
+    if ( checkers ) {
+        if ( checkers & ( checkers - 1 ) )
+            mask = BB_EMPTY;
+        else
+            mask = checkers | between_bb( ksq, bb_lsb(checkers) );
+    }
+
+    // pinned pieces, and the ray each may move along
+    Bitboard pinned(BB_EMPTY);
+    Bitboard pin_ray[64];
+    Bitboard theirs = _bb_side[them];
+    Bitboard rq     = ( _bb_type[PT_ROOK] | _bb_type[PT_QUEEN] ) & theirs;
+    Bitboard bq     = ( _bb_type[PT_BISHOP] | _bb_type[PT_QUEEN] ) & theirs;
+    Bitboard snipers = ( rook_attacks( ksq, theirs ) & rq ) | ( bishop_attacks( ksq, theirs ) & bq );
+    while ( snipers ) {
+        int      sq  = bb_pop(snipers);
+        Bitboard btw = between_bb( ksq, sq );
+        Bitboard blk = btw & occ;
+        if ( blk && ( blk & ( blk - 1 ) ) == 0 && ( blk & own ) ) {
+            pinned |= blk;
+            pin_ray[ bb_lsb(blk) ] = btw | bb_bit(sq);
+        }
+    }
+
+    Bitboard bb = own;
+    while ( bb ) {
+        int       org = bb_pop(bb);
+        PieceType pt  = byte_type(_mailbox[org]);
+        Bitboard  allowed = ( bb_test( pinned, org ) ) ? mask & pin_ray[org] : mask;
+        switch ( pt ) {
+        case PT_PAWN:
+        case PT_PAWN_OFF:
+            if ( mask != BB_EMPTY )
+                gen_pawn_moves( org, s, allowed, true, moves );
+            break;
+        case PT_KNIGHT:
+            push_moves( org, knight_attacks(org) & ~own & allowed, moves );
+            break;
+        case PT_KING: {
+            Bitboard trgs = king_attacks(ksq) & ~own;
+            Bitboard lifted = occ ^ kbb;
+            while ( trgs ) {
+                int dst = bb_pop(trgs);
+                if ( attackers_to( dst, them, lifted ) == BB_EMPTY )
+                    moves.push_back(MovePacked( ( _mailbox[dst] ) ? MV_CAPTURE : MV_MOVE, org, dst ));
+            }
+            if ( checkers == BB_EMPTY )
+                gen_castle_moves( org, s, moves );
+            break;
+        }
+        default:
+            push_moves( org, slider_attacks( pt, org, occ ) & ~own & allowed, moves );
+            break;
+        }
+    }
+    return moves;
+}
+
+// record a move from org to each square in trgs - a capture if the
+// square is occupied. trgs must not include friendly pieces.
+void Board::push_moves( int org, Bitboard trgs, MoveArray& moves ) const {
+    while ( trgs ) {
+        int dst = bb_pop(trgs);
+        moves.push_back(MovePacked( ( _mailbox[dst] ) ? MV_CAPTURE : MV_MOVE, org, dst ));
+    }
+}
+
+void Board::gen_pawn_moves( int org, Side s, Bitboard allowed, bool legal, MoveArray& moves ) const {
+    // See get_pawn_moves() for the rules. Here the pawn's single and
+    // double pushes, captures and en passant are all done with square
+    // arithmetic and bitboards. Only targets in allowed are produced,
+    // and when legal is set en passant is checked for exposing the king.
+    static const MoveAction promotions[] = { MV_PROM_QUEEN, MV_PROM_BISHOP, MV_PROM_KNIGHT, MV_PROM_ROOK };
+
+    bool     isBlack = IS_BLACK(s);
+    int      fwd     = ( isBlack ) ? -8 : 8;
+    Rank     rank    = sq_rank(org);
+    Rank     pnhm    = ( isBlack ) ? R7 : R2;
+    Rank     last    = ( isBlack ) ? R1 : R8;
+    if ( rank == last )
+        return; // can't happen in a real game - nowhere to go
+
+    Bitboard att = pawn_attacks( org, s );
+    bool     promo   = sq_rank( org + fwd ) == last;
+
+    // Case 1 & 2: single push, and double push from the home rank
+    int pos = org + fwd;
+    if ( _mailbox[pos] == 0 ) {
+        if ( bb_test( allowed, pos ) ) {
+            if ( promo ) {
+                for ( auto action : promotions )
+                    moves.push_back(MovePacked( action, org, pos ));
+            } else {
+                moves.push_back(MovePacked( MV_MOVE, org, pos ));
+            }
+        }
+        // the double push may block a check the single push doesn't
+        if ( rank == pnhm && _mailbox[pos + fwd] == 0 && bb_test( allowed, pos + fwd ) )
+            moves.push_back(MovePacked( MV_MOVE, org, pos + fwd ));
+    }
+
+    // Case 3: captures, which may also promote
+    Bitboard trgs = att & _bb_side[OTHER_SIDE(s)] & allowed;
+    while ( trgs ) {
+        int dst = bb_pop(trgs);
+        if ( promo ) {
+            for ( auto action : promotions )
+                moves.push_back(MovePacked( action, org, dst ));
+        } else {
+            moves.push_back(MovePacked( MV_CAPTURE, org, dst ));
+        }
+    }
+
+    // Case 4: en passant. The target square is behind the pawn that
+    // just moved two squares, which must still be there.
+    if ( has_en_passant() ) {
+        Rank r_pawn = ( isBlack ) ? R4 : R5;
+        Rank r_move = ( isBlack ) ? R3 : R6;
+        int  epos   = RNF( r_move, _en_passant.file() );
+        int  vict   = RNF( r_pawn, _en_passant.file() );
+        if ( ( att & bb_bit(epos) ) && _mailbox[epos] == 0
+          && _mailbox[vict] == make_byte( PT_PAWN, OTHER_SIDE(s) )
+          && ( !legal || en_passant_is_safe( org, epos, vict ) ) )
+            moves.push_back(MovePacked( MV_EN_PASSANT, org, epos ));
+    }
+}
+
+// true if the side on-move's pawn on org taking en passant (landing on
+// epos, removing the pawn on vict) does not leave its own king attacked.
+// Both pawns are lifted and ours dropped on epos, which catches the rank
+// pins that only appear when two pieces leave at once.
+bool Board::en_passant_is_safe( int org, int epos, int vict ) const {
+    Side     s   = _on_move;
+    Bitboard kbb = _bb_type[PT_KING] & _bb_side[s];
+    if ( kbb == BB_EMPTY )
+        return true;
+    Bitboard occ = ( occupied() ^ bb_bit(org) ^ bb_bit(vict) ) | bb_bit(epos);
+    return ( attackers_to( bb_lsb(kbb), OTHER_SIDE(s), occ ) & ~bb_bit(vict) ) == BB_EMPTY;
+}
+
+// true if the side on-move has a legal en passant capture
+bool Board::can_capture_en_passant() const {
+    if ( !has_en_passant() )
+        return false;
+    Side     s      = _on_move;
+    Side     them   = OTHER_SIDE(s);
+    Rank     r_move = ( IS_BLACK(s) ) ? R3 : R6;
+    Rank     r_pawn = ( IS_BLACK(s) ) ? R4 : R5;
+    int      epos   = RNF( r_move, _en_passant.file() );
+    int      vict   = RNF( r_pawn, _en_passant.file() );
+    if ( _mailbox[epos] != 0 || _mailbox[vict] != make_byte( PT_PAWN, them ) )
+        return false;
+    // our pawns that could capture onto epos are those a pawn of theirs
+    // standing on epos would attack
+    Bitboard pawns = pawn_attacks( epos, them ) & pawns_bb(s);
+    while ( pawns )
+        if ( en_passant_is_safe( bb_pop(pawns), epos, vict ) )
+            return true;
+    return false;
+}
+
+void Board::gen_castle_moves( int org, Side s, MoveArray& moves ) const {
+    // 1. The king and rook must have not moved
+    // 2. The squares between the king and the rook have to be empty [8A4b],
+    // 3. The king cannot be in check [8A4a], and
+    // 4. The king cannot move over check [8A4a].
+    //
+    // The king lands on Fg (kingside) or Fc (queenside), so the squares
+    // that must not be attacked are the king's own square through the
+    // landing square. The rook is recorded as the move's target.
+    Rank     home = ( IS_BLACK(s) ) ? R8 : R1;
+    Bitboard occ  = occupied();
+    uint8_t  rook = make_byte( PT_ROOK, s );
+    if ( sq_rank(org) != home )
+        return;
+
+    if ( side_can_castle_kingside(s) ) {
+        int rsq = RNF( home, Fh );
+        int ksq = RNF( home, Fg );
+        Bitboard between = ( ( 1ULL << rsq ) - 1 ) & ~( ( 2ULL << org ) - 1 );
+        if ( _mailbox[rsq] == rook && ( between & occ ) == 0 ) {
+            bool is_clear(true);
+            for ( int idx(org); idx <= ksq && is_clear; ++idx )
+                is_clear = attackers_to( idx, OTHER_SIDE(s), occ ) == BB_EMPTY;
+            if ( is_clear )
+                moves.push_back(MovePacked( MV_CASTLE_KINGSIDE, org, rsq ));
+        }
+    }
+    if ( side_can_castle_queenside(s) ) {
+        int rsq = RNF( home, Fa );
+        int ksq = RNF( home, Fc );
+        Bitboard between = ( ( 1ULL << org ) - 1 ) & ~( ( 2ULL << rsq ) - 1 );
+        if ( _mailbox[rsq] == rook && ( between & occ ) == 0 ) {
+            bool is_clear(true);
+            for ( int idx(org); idx >= ksq && is_clear; --idx )
+                is_clear = attackers_to( idx, OTHER_SIDE(s), occ ) == BB_EMPTY;
+            if ( is_clear )
+                moves.push_back(MovePacked( MV_CASTLE_QUEENSIDE, org, rsq ));
+        }
+    }
+}
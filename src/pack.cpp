@@ -1,6 +1,11 @@
 // pack board into binary
+#include <immintrin.h>
+
+#include <cstring>
+
 #include "constants.h"
 #include "board.h"
+#include "zobrist.h"
 
 #pragma pack(1)
 union jig_dw2b {
@@ -23,11 +28,10 @@ union jig_n2b {
 };
 #pragma pack()
 
-BoardPacked Board::pack() const {
-    BoardPacked ret;
-
+// the game information word of a BoardPacked
+uint64_t Board::pack_info() const {
     GameInformation gi;
-    gi.f.piece_cnt = _pm.size();
+    gi.f.piece_cnt = piece_cnt();
     gi.f.castle_white_queenside = (_castle_white_queenside)?1:0;
     gi.f.castle_white_kingside  = (_castle_white_kingside) ?1:0;
     gi.f.castle_black_queenside = (_castle_black_queenside)?1:0;
@@ -37,8 +41,27 @@ BoardPacked Board::pack() const {
     gi.f.unused                 = 0;
     gi.f.half_move_clock        = _half_move_clock;
     gi.f.full_move_cnt          = _full_move_cnt;
+    return gi.i;
+}
 
-    ret.f.gi = gi.i;
+void Board::unpack_info( uint64_t info ) {
+    GameInformation gi;
+    gi.i = info;
+    _castle_white_queenside = gi.f.castle_white_queenside == 1;
+    _castle_white_kingside  = gi.f.castle_white_kingside  == 1;
+    _castle_black_queenside = gi.f.castle_black_queenside == 1;
+    _castle_black_kingside  = gi.f.castle_black_kingside  == 1;
+    _on_move                = ( gi.f.on_move == 1 ) ? SIDE_BLACK : SIDE_WHITE;
+    _en_passant             = ( gi.f.en_passant == SQ_NONE ) ? Square::UNBOUNDED
+                                                             : Square(RnF(gi.f.en_passant));
+    _half_move_clock        = gi.f.half_move_clock;
+    _full_move_cnt          = gi.f.full_move_cnt;
+}
+
+BoardPacked Board::pack() const {
+    BoardPacked ret;
+
+    ret.f.gi = pack_info();
     ret.f.pop = ret.f.hi = ret.f.lo = 0;
 
     int      bit(63);
@@ -48,14 +71,13 @@ BoardPacked Board::pack() const {
     uint8_t *bytes = pieces.b;
     for ( short rank(R8); rank >= R1; --rank ) {
         for ( short file(Fa); file <= Fh; ++file, --bit ) {
-            Square sq(rank,file);
-            auto itr = _pm.find(sq);
-            if ( itr != _pm.end() ) {
+            uint8_t by = _mailbox[RNF(rank,file)];
+            if ( by ) {
                 ret.f.pop |= (1ULL << bit);
                 if (hilo) {
-                    n2b.n.hi = itr->second->byte();
+                    n2b.n.hi = by;
                 } else {
-                    n2b.n.lo = itr->second->byte();
+                    n2b.n.lo = by;
                     *bytes++ = n2b.b;
                     n2b.b = 0;
                 }
@@ -76,19 +98,9 @@ BoardPacked Board::pack() const {
 void Board::unpack(BoardPacked pack) {
     jig_dw2b pieces;
 
-    GameInformation gi;
-    gi.i = pack.f.gi;
- 
-    _castle_white_queenside = gi.f.castle_white_queenside == 1;
-    _castle_white_kingside  = gi.f.castle_white_kingside  == 1;
-    _castle_black_queenside = gi.f.castle_black_queenside == 1;
-    _castle_black_kingside  = gi.f.castle_black_kingside  == 1;
-    _on_move                = ( gi.f.on_move == 1 ) ? SIDE_BLACK : SIDE_WHITE;
-    _en_passant             = Square(RnF(gi.f.en_passant));
-    _half_move_clock        = gi.f.half_move_clock;
-    _full_move_cnt          = gi.f.full_move_cnt;
+    clear();
+    unpack_info( pack.f.gi );
 
-    _pm.clear();
     pieces.dw[0] = pack.f.lo;
     pieces.dw[1] = pack.f.hi;
     bool hilo(true);
@@ -106,15 +118,167 @@ void Board::unpack(BoardPacked pack) {
                     by = n2b.n.hi;
                 } else {
                     by = n2b.n.lo;
-                    n2b.b = *bytes++;
+                    if ( bytes < pieces.b + sizeof(pieces.b) )
+                        n2b.b = *bytes++;
                 }
                 hilo = !hilo;
-                PieceType pt = PieceType(by & 0x07);
-                Side      s   = Side((by & 0x08)?SIDE_BLACK:SIDE_WHITE);
-                set( Square(rank, file), pt, s );
+                put_byte( RNF(rank,file), by );
             }
         }
     }
+
+    _key = compute_key();
+}
+
+BoardPacked Board::pack_identity() const {
+    BoardPacked     ret = pack();
+    GameInformation gi;
+    gi.i = ret.f.gi;
+    gi.f.half_move_clock = 0;
+    gi.f.full_move_cnt   = 0;
+    if ( !can_capture_en_passant() )
+        gi.f.en_passant = SQ_NONE;
+    ret.f.gi = gi.i;
+    return ret;
+}
+
+uint64_t Board::identity_key() const {
+    if ( has_en_passant() && !can_capture_en_passant() )
+        return _key ^ zobrist.en_passant[ _en_passant.file() ];
+    return _key;
+}
+
+// Batch conversion
+//
+// The pop bitmap lists squares from a8 to h8, then a7 to h7 and so on
+// down to h1, with a8 in bit 63. That is the board's occupancy with the
+// bits of each rank reversed. The nibble stream holds the piece bytes in
+// that same order, starting at the low nibble of lo.
+//
+// The mailbox stores each rank as 8 bytes, one per file, and every byte
+// fits in a nibble. Two ranks at a time:
+// - pack PEXTs the low nibble of each byte into a 64-bit word, then
+//   PEXTs that word against the occupied squares' nibbles.
+// - unpack runs the same steps in reverse with PDEP.
+// Unpacking then rebuilds the piece-type and side bitboards from the
+// mailbox with AVX2 byte compares, 32 squares per instruction.
+//
+// Both need BMI2, and unpacking also needs AVX2. Without them the batch
+// calls fall back to pack() and unpack() per position. The fast paths
+// produce exactly the same bytes and boards as the scalar code.
+
+// these may run before any other static initializer has called
+// __builtin_cpu_init(), so call it here
+static bool cpu_supports_bmi2() { __builtin_cpu_init(); return __builtin_cpu_supports("bmi2"); }
+static bool cpu_supports_avx2() { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }
+
+static const bool pack_use_bmi2 = cpu_supports_bmi2();
+static const bool pack_use_avx2 = cpu_supports_avx2();
+
+#define NIBBLE_LANES   0x0f0f0f0f0f0f0f0fULL
+#define NIBBLE_UNITS   0x1111111111111111ULL
+
+// reverse the bit order within each byte - a1..h1 <-> the pop layout
+static inline uint64_t reverse_rank_bits( uint64_t x ) {
+    x = ( ( x >> 1 ) & 0x5555555555555555ULL ) | ( ( x & 0x5555555555555555ULL ) << 1 );
+    x = ( ( x >> 2 ) & 0x3333333333333333ULL ) | ( ( x & 0x3333333333333333ULL ) << 2 );
+    x = ( ( x >> 4 ) & 0x0f0f0f0f0f0f0f0fULL ) | ( ( x & 0x0f0f0f0f0f0f0f0fULL ) << 4 );
+    return x;
+}
+
+// occupancy of ranks hi and hi-1 as 16 bits, rank hi in the low byte
+static inline uint64_t rank_pair( uint64_t occ, int hi ) {
+    return ( ( occ >> ( 8 * hi ) ) & 0xff ) | ( ( ( occ >> ( 8 * ( hi - 1 ) ) ) & 0xff ) << 8 );
+}
+
+__attribute__((target("bmi2")))
+BoardPacked Board::pack_fast() const {
+    BoardPacked ret;
+    Bitboard    occ = occupied();
+    ret.f.gi  = pack_info();
+    ret.f.pop = reverse_rank_bits(occ);
+
+    unsigned __int128 stream(0);
+    int               used(0);
+    for ( int hi(R8); hi > R1 && used < 128; hi -= 2 ) {
+        uint64_t a, b;
+        std::memcpy( &a, _mailbox + 8 * hi, 8 );
+        std::memcpy( &b, _mailbox + 8 * ( hi - 1 ), 8 );
+        uint64_t nib  = _pext_u64( a, NIBBLE_LANES ) | ( _pext_u64( b, NIBBLE_LANES ) << 32 );
+        uint64_t pair = rank_pair( occ, hi );
+        uint64_t mask = _pdep_u64( pair, NIBBLE_UNITS ) * 0x0f;
+        stream |= (unsigned __int128)_pext_u64( nib, mask ) << used;
+        used   += 4 * bb_count(pair);
+    }
+    ret.f.lo = uint64_t(stream);
+    ret.f.hi = uint64_t( stream >> 64 );
+    return ret;
+}
+
+// squares whose mailbox byte (split over l and h) equals v's
+__attribute__((target("avx2")))
+static inline Bitboard bytes_equal( __m256i l, __m256i h, __m256i v ) {
+    return uint64_t( uint32_t( _mm256_movemask_epi8( _mm256_cmpeq_epi8( l, v ) ) ) )
+         | ( uint64_t( uint32_t( _mm256_movemask_epi8( _mm256_cmpeq_epi8( h, v ) ) ) ) << 32 );
+}
+
+// rebuild the bitboards from the mailbox
+__attribute__((target("avx2")))
+static void mailbox_bitboards( const uint8_t *mailbox, Bitboard *bb_type, Bitboard *bb_side ) {
+    __m256i lo    = _mm256_loadu_si256( (const __m256i *)mailbox );
+    __m256i hi    = _mm256_loadu_si256( (const __m256i *)( mailbox + 32 ) );
+    __m256i seven = _mm256_set1_epi8( 0x07 );
+    __m256i black = _mm256_set1_epi8( 0x08 );
+    __m256i tlo   = _mm256_and_si256( lo, seven );
+    __m256i thi   = _mm256_and_si256( hi, seven );
+    Bitboard occ = ~bytes_equal( lo, hi, _mm256_setzero_si256() );
+    bb_type[PT_EMPTY] = BB_EMPTY;
+    for ( int pt(PT_KING); pt <= PT_PAWN_OFF; ++pt )
+        bb_type[pt] = bytes_equal( tlo, thi, _mm256_set1_epi8( char(pt) ) );
+    bb_side[SIDE_BLACK] = bytes_equal( _mm256_and_si256( lo, black ), _mm256_and_si256( hi, black ), black );
+    bb_side[SIDE_WHITE] = occ & ~bb_side[SIDE_BLACK];
+}
+
+__attribute__((target("bmi2")))
+void Board::unpack_fast( const BoardPacked& pack ) {
+    unpack_info( pack.f.gi );
+
+    Bitboard          occ    = reverse_rank_bits( pack.f.pop );
+    unsigned __int128 stream = ( (unsigned __int128)pack.f.hi << 64 ) | pack.f.lo;
+    for ( int hi(R8); hi > R1; hi -= 2 ) {
+        uint64_t pair = rank_pair( occ, hi );
+        uint64_t mask = _pdep_u64( pair, NIBBLE_UNITS ) * 0x0f;
+        uint64_t nib  = _pdep_u64( uint64_t(stream), mask );
+        uint64_t a    = _pdep_u64( nib, NIBBLE_LANES );
+        uint64_t b    = _pdep_u64( nib >> 32, NIBBLE_LANES );
+        std::memcpy( _mailbox + 8 * hi, &a, 8 );
+        std::memcpy( _mailbox + 8 * ( hi - 1 ), &b, 8 );
+        stream >>= 4 * bb_count(pair);
+    }
+    mailbox_bitboards( _mailbox, _bb_type, _bb_side );
+    _key = compute_key();
+}
+
+void Board::pack_many( const Board *boards, BoardPacked *packs, size_t cnt ) {
+    if ( !pack_use_bmi2 ) {
+        for ( size_t idx(0); idx < cnt; ++idx )
+            packs[idx] = boards[idx].pack();
+        return;
+    }
+    for ( size_t idx(0); idx < cnt; ++idx )
+        packs[idx] = boards[idx].pack_fast();
+}
+
+void Board::unpack_many( const BoardPacked *packs, Board *boards, size_t cnt ) {
+    bool fast = pack_use_bmi2 && pack_use_avx2;
+    for ( size_t idx(0); idx < cnt; ++idx ) {
+        // more than 32 pieces can't be a real position, and can't be
+        // stored in the nibble stream - leave those to the slow path.
+        if ( fast && bb_count( packs[idx].f.pop ) <= 32 )
+            boards[idx].unpack_fast( packs[idx] );
+        else
+            boards[idx].unpack( packs[idx] );
+    }
 }
 
 std::ostream& operator<<(std::ostream& os, const BoardPacked& p) {
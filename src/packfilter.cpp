@@ -0,0 +1,67 @@
+#include <cmath>
+
+#include "packfilter.h"
+#include "packset.h"
+
+PackFilter::PackFilter( uint64_t expected, double fp_rate ) {
+    if ( expected < 1 )
+        expected = 1;
+    if ( !( fp_rate > 0 && fp_rate < 1 ) )
+        fp_rate = 0.01;
+    double ln2  = std::log(2.0);
+    double bits = 1.1 * -std::log(fp_rate) / ( ln2 * ln2 );    // per key
+    _k          = std::max( 1, std::min( 16, int( std::lround( bits * ln2 ) ) ) );
+    _cnt        = std::max<uint64_t>( 1, uint64_t( std::ceil( bits * expected / 512 ) ) );
+    _blocks     = std::make_unique<Block[]>(_cnt);
+    clear();
+}
+
+void PackFilter::clear() {
+    for ( uint64_t idx(0); idx < _cnt; ++idx )
+        for ( auto& w : _blocks[idx].w )
+            w.store( 0, std::memory_order_relaxed );
+}
+
+size_t PackFilter::size_bytes() const { return _cnt * sizeof(Block); }
+int    PackFilter::hashes() const     { return _k; }
+
+// the block is picked by the hash's high bits (multiply-shift, so the
+// block count needn't be a power of two), and the bits within it by a
+// rehash, nine bits per position.
+const PackFilter::Block& PackFilter::block_for( uint64_t h ) const {
+    return _blocks[ uint64_t( ( (unsigned __int128)h * _cnt ) >> 64 ) ];
+}
+
+#define NEXT_POSITIONS(g) ( (g) = (g) * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL )
+
+bool PackFilter::insert( const BoardPacked& key ) {
+    uint64_t h     = pack_hash(key);
+    Block&   blk   = const_cast<Block&>( block_for(h) );
+    uint64_t g     = h;
+    bool     fresh(false);
+    for ( int i(0); i < _k; ++i ) {
+        if ( i % 7 == 0 )
+            NEXT_POSITIONS(g);
+        unsigned pos = ( g >> ( 9 * ( i % 7 ) ) ) & 511;
+        uint64_t bit = 1ULL << ( pos & 63 );
+        std::atomic<uint64_t>& w = blk.w[ pos >> 6 ];
+        // skip the locked RMW when the bit is already set
+        if ( !( w.load( std::memory_order_relaxed ) & bit ) )
+            fresh |= !( w.fetch_or( bit, std::memory_order_relaxed ) & bit );
+    }
+    return fresh;
+}
+
+bool PackFilter::maybe_contains( const BoardPacked& key ) const {
+    uint64_t     h   = pack_hash(key);
+    const Block& blk = block_for(h);
+    uint64_t     g   = h;
+    for ( int i(0); i < _k; ++i ) {
+        if ( i % 7 == 0 )
+            NEXT_POSITIONS(g);
+        unsigned pos = ( g >> ( 9 * ( i % 7 ) ) ) & 511;
+        if ( !( blk.w[ pos >> 6 ].load( std::memory_order_relaxed ) & ( 1ULL << ( pos & 63 ) ) ) )
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,207 @@
+#include <immintrin.h>
+
+#include <algorithm>
+
+#include "packset.h"
+
+PackSet::Table::Table( uint64_t capacity )
+: next(nullptr), claimed(0), moved(0)
+{
+    uint64_t pow2(64);
+    while ( pow2 < capacity )
+        pow2 *= 2;
+    mask = pow2 - 1;
+    tags = std::make_unique<std::atomic<uint32_t>[]>(pow2);     // zeroed - all empty
+    keys = std::unique_ptr<BoardPacked[]>( new BoardPacked[pow2] );
+}
+
+PackSet::PackSet( uint64_t capacity ) {
+    _tables.push_back( std::make_unique<Table>(capacity) );
+    _current.store( _tables.back().get(), std::memory_order_release );
+    for ( auto& c : _size )
+        c.cnt.store( 0, std::memory_order_relaxed );
+}
+
+PackSet::~PackSet() {}
+
+void PackSet::clear() {
+    Table *t = _current.load( std::memory_order_acquire );
+    // a move can't be under way with no other calls running, but the
+    // newest table is the one to keep regardless
+    while ( Table *n = t->next.load( std::memory_order_acquire ) )
+        t = n;
+    for ( auto& p : _tables )
+        if ( p.get() == t )
+            p.swap( _tables.front() );
+    _tables.resize(1);
+    for ( uint64_t idx(0); idx <= t->mask; ++idx )
+        t->tags[idx].store( 0, std::memory_order_relaxed );
+    t->next.store( nullptr, std::memory_order_relaxed );
+    t->claimed.store( 0, std::memory_order_relaxed );
+    t->moved.store( 0, std::memory_order_relaxed );
+    _current.store( t, std::memory_order_release );
+    for ( auto& c : _size )
+        c.cnt.store( 0, std::memory_order_relaxed );
+}
+
+uint64_t PackSet::capacity() const {
+    return _current.load( std::memory_order_acquire )->mask + 1;
+}
+
+uint64_t PackSet::size() const {
+    uint64_t sum(0);
+    for ( auto& c : _size )
+        sum += c.cnt.load( std::memory_order_relaxed );
+    return sum;
+}
+
+double PackSet::load() const {
+    return double( size() ) / double( capacity() );
+}
+
+PackSet::Insert PackSet::insert( const BoardPacked& key ) {
+    Table *t = _current.load( std::memory_order_acquire );
+    if ( t->next.load( std::memory_order_acquire ) )
+        help_move(t);
+    return insert_into( t, key, pack_hash(key), true );
+}
+
+// Insert key (whose hash is h) into t, or a table after it. counted is
+// false when moving a key between tables, as it is already in size().
+// The fingerprint comes from the high bits, the slot from the low bits.
+PackSet::Insert PackSet::insert_into( Table *t, const BoardPacked& key, uint64_t h, bool counted ) {
+    uint32_t fp    = uint32_t( h >> 34 ) & TAG_FP;
+    uint32_t ready = fp | TAG_USED | TAG_READY;
+    for ( ;; ) {
+        uint64_t idx = h & t->mask;
+        for ( int probe(0); probe < MAX_PROBE; ++probe, idx = ( idx + 1 ) & t->mask ) {
+            uint32_t tag = t->tags[idx].load( std::memory_order_acquire );
+            if ( tag == 0 ) {
+                if ( t->tags[idx].compare_exchange_strong( tag, fp | TAG_USED, std::memory_order_acq_rel ) ) {
+                    t->keys[idx] = key;
+                    t->tags[idx].store( ready, std::memory_order_release );
+                    if ( !counted )
+                        return INSERTED;
+                    uint64_t cnt = _size[ ( h >> 26 ) % STRIPES ].cnt.fetch_add( 1, std::memory_order_relaxed ) + 1;
+                    // the stripes share the keys about evenly, so one
+                    // stripe's count stands in for the set's
+                    if ( cnt * STRIPES > ( t->mask + 1 ) / 4 * 3
+                      && !t->next.load( std::memory_order_acquire ) ) {
+                        start_move( t, 2 * ( t->mask + 1 ) );
+                        help_move(t);
+                    }
+                    return INSERTED;
+                }
+                // lost the race for this slot - tag now holds the winner's
+            }
+            if ( tag == TAG_MOVED )
+                break;      // frozen while empty - the key isn't in t
+            if ( ( tag & TAG_FP ) != fp )
+                continue;
+            while ( !( tag & TAG_READY ) ) {
+                _mm_pause();
+                tag = t->tags[idx].load( std::memory_order_acquire );
+            }
+            if ( t->keys[idx] == key )
+                return PRESENT;
+        }
+        // t is frozen here, or has no room - go on to the next table
+        if ( !t->next.load( std::memory_order_acquire ) )
+            start_move( t, 2 * ( t->mask + 1 ) );
+        help_move(t);
+        t = t->next.load( std::memory_order_acquire );
+    }
+}
+
+bool PackSet::contains( const BoardPacked& key ) const {
+    uint64_t     h  = pack_hash(key);
+    uint32_t     fp = uint32_t( h >> 34 ) & TAG_FP;
+    const Table *t  = _current.load( std::memory_order_acquire );
+    while ( t ) {
+        uint64_t idx = h & t->mask;
+        for ( int probe(0); probe < MAX_PROBE; ++probe, idx = ( idx + 1 ) & t->mask ) {
+            uint32_t tag = t->tags[idx].load( std::memory_order_acquire );
+            if ( tag == 0 )
+                return false;
+            if ( tag == TAG_MOVED )
+                break;
+            if ( ( tag & TAG_FP ) != fp )
+                continue;
+            while ( !( tag & TAG_READY ) ) {
+                _mm_pause();
+                tag = t->tags[idx].load( std::memory_order_acquire );
+            }
+            if ( t->keys[idx] == key )
+                return true;
+        }
+        t = t->next.load( std::memory_order_acquire );
+    }
+    return false;
+}
+
+// link a table of capacity slots behind t, unless one already is
+void PackSet::start_move( Table *t, uint64_t capacity ) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if ( t->next.load( std::memory_order_acquire ) )
+        return;
+    _tables.push_back( std::make_unique<Table>(capacity) );
+    t->next.store( _tables.back().get(), std::memory_order_release );
+}
+
+// move chunks of t into its next table until none are left to take. The
+// thread finishing the last one makes the newest fully moved-into table
+// current.
+void PackSet::help_move( Table *t ) {
+    uint64_t chunks = t->chunks();
+    while ( t->claimed.load( std::memory_order_relaxed ) < chunks ) {
+        uint64_t c = t->claimed.fetch_add( 1, std::memory_order_relaxed );
+        if ( c >= chunks )
+            break;
+        move_chunk( t, c );
+        if ( t->moved.fetch_add( 1, std::memory_order_acq_rel ) + 1 < chunks )
+            continue;
+        // a later table may have been filled before this one finished
+        Table *cur = _current.load( std::memory_order_acquire );
+        for ( ;; ) {
+            Table *n = cur->next.load( std::memory_order_acquire );
+            if ( !n || cur->moved.load( std::memory_order_acquire ) < cur->chunks() )
+                break;
+            if ( _current.compare_exchange_strong( cur, n, std::memory_order_acq_rel ) )
+                cur = n;
+        }
+    }
+}
+
+// freeze every slot of the chunk, copying its keys to the next table
+void PackSet::move_chunk( Table *t, uint64_t chunk ) {
+    Table   *n   = t->next.load( std::memory_order_acquire );
+    uint64_t end = std::min( ( chunk + 1 ) * CHUNK, t->mask + 1 );
+    for ( uint64_t idx( chunk * CHUNK ); idx < end; ++idx ) {
+        uint32_t tag = t->tags[idx].load( std::memory_order_acquire );
+        while ( !( tag & TAG_READY ) ) {
+            if ( tag == 0 && t->tags[idx].compare_exchange_strong( tag, TAG_MOVED, std::memory_order_acq_rel ) )
+                break;
+            // claimed and still pending, or claimed just now
+            _mm_pause();
+            tag = t->tags[idx].load( std::memory_order_acquire );
+        }
+        if ( tag & TAG_READY ) {
+            t->tags[idx].fetch_or( TAG_MOVED, std::memory_order_acq_rel );
+            insert_into( n, t->keys[idx], pack_hash( t->keys[idx] ), false );
+        }
+    }
+}
+
+void PackSet::grow( uint64_t capacity ) {
+    for ( ;; ) {
+        Table *t = _current.load( std::memory_order_acquire );
+        while ( Table *n = t->next.load( std::memory_order_acquire ) ) {
+            help_move(t);
+            t = n;
+        }
+        if ( t->mask + 1 >= capacity )
+            return;
+        start_move( t, capacity );
+        help_move(t);
+    }
+}
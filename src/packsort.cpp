@@ -0,0 +1,331 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+
+#include "packsort.h"
+#include "util.h"
+
+// below this many records a bucket is finished with a comparison sort
+#define RADIX_CUTOFF 64
+
+// American flag sort - histogram the records on one byte, permute them
+// into their buckets in place, and recurse into each bucket on the next
+// byte. Bytes no record differs in (the unused low bits of the game
+// information, for one) are skipped outright, and a byte every record
+// in a bucket shares costs a counting pass and nothing more.
+static void msd_sort( BoardPacked *recs, size_t cnt, int byte, const bool *varies ) {
+    while ( cnt >= RADIX_CUTOFF && byte < int(sizeof(BoardPacked)) ) {
+        if ( !varies[byte] ) {
+            byte++;
+            continue;
+        }
+        size_t count[256] = {};
+        for ( size_t idx(0); idx < cnt; ++idx )
+            count[ recs[idx].b[byte] ]++;
+        if ( count[ recs[0].b[byte] ] == cnt ) {
+            byte++;
+            continue;
+        }
+
+        size_t start[256], next[256];
+        size_t sum(0);
+        for ( int bkt(0); bkt < 256; ++bkt ) {
+            start[bkt] = next[bkt] = sum;
+            sum += count[bkt];
+        }
+        // swap each record into its bucket until every bucket is full
+        for ( int bkt(0); bkt < 256; ++bkt ) {
+            size_t end = start[bkt] + count[bkt];
+            while ( next[bkt] < end ) {
+                BoardPacked rec = recs[ next[bkt] ];
+                int         dst = rec.b[byte];
+                while ( dst != bkt ) {
+                    std::swap( rec, recs[ next[dst]++ ] );
+                    dst = rec.b[byte];
+                }
+                recs[ next[bkt]++ ] = rec;
+            }
+        }
+        for ( int bkt(0); bkt < 256; ++bkt )
+            if ( count[bkt] > 1 )
+                msd_sort( recs + start[bkt], count[bkt], byte + 1, varies );
+        return;
+    }
+    if ( cnt > 1 && byte < int(sizeof(BoardPacked)) )
+        std::sort( recs, recs + cnt );
+}
+
+void radix_sort( BoardPacked *recs, size_t cnt ) {
+    // find the bytes that differ anywhere, so the sort can step over the
+    // rest without even counting them
+    if ( cnt < 2 )
+        return;
+    BoardPacked diff;
+    for ( size_t idx(1); idx < cnt; ++idx ) {
+        diff.f.gi  |= recs[idx].f.gi  ^ recs[0].f.gi;
+        diff.f.pop |= recs[idx].f.pop ^ recs[0].f.pop;
+        diff.f.lo  |= recs[idx].f.lo  ^ recs[0].f.lo;
+        diff.f.hi  |= recs[idx].f.hi  ^ recs[0].f.hi;
+    }
+    bool varies[sizeof(BoardPacked)];
+    for ( size_t byte(0); byte < sizeof(BoardPacked); ++byte )
+        varies[byte] = diff.b[byte] != 0;
+    msd_sort( recs, cnt, 0, varies );
+}
+
+size_t dedup_sorted( BoardPacked *recs, size_t cnt ) {
+    return std::unique( recs, recs + cnt ) - recs;
+}
+
+PackSorter::PackSorter( size_t ram_mb, const std::string& tmp_dir )
+: _tmp_dir(tmp_dir), _fd(-1), _end(0), _added(0), _emitted(0)
+{
+    _capacity = std::max<size_t>( ( ram_mb << 20 ) / sizeof(BoardPacked), PACKSTORE_BLOCK );
+    _buf.reserve(_capacity);
+}
+
+PackSorter::~PackSorter() {
+    drop_runs();
+}
+
+uint64_t PackSorter::added() const   { return _added; }
+uint64_t PackSorter::emitted() const { return _emitted; }
+size_t   PackSorter::run_cnt() const { return _runs.size(); }
+
+bool PackSorter::add( const BoardPacked& rec ) {
+    return add( &rec, 1 );
+}
+
+bool PackSorter::add( const BoardPacked *recs, size_t cnt ) {
+    while ( cnt ) {
+        // a full buffer is swapped out under the lock and spilled outside
+        // it, so other threads keep adding while this one sorts and writes
+        std::vector<BoardPacked> full;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            size_t n = std::min( cnt, _capacity - _buf.size() );
+            _buf.insert( _buf.end(), recs, recs + n );
+            _added += n;
+            recs   += n;
+            cnt    -= n;
+            if ( _buf.size() == _capacity ) {
+                full.swap(_buf);
+                _buf.reserve(_capacity);
+            }
+        }
+        if ( !full.empty() && !spill(full) )
+            return false;
+    }
+    return true;
+}
+
+// a new temporary file in tmp_dir, already unlinked - it is gone from the
+// directory, and kept only until closed. -1 on failure.
+int PackSorter::open_tmp() const {
+    std::string path = _tmp_dir + "/garth-run-XXXXXX";
+    int fd = mkstemp( &path[0] );
+    if ( fd >= 0 )
+        unlink( path.c_str() );
+    return fd;
+}
+
+// sort, dedup and write out recs as a new run. Its place in the run file
+// is taken under the lock; the write itself is not.
+bool PackSorter::spill( std::vector<BoardPacked>& recs ) {
+    radix_sort( recs.data(), recs.size() );
+    size_t   cnt   = dedup_sorted( recs.data(), recs.size() );
+    uint64_t bytes = cnt * sizeof(BoardPacked);
+    uint64_t off;
+    int      fd;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if ( _fd < 0 && ( _fd = open_tmp() ) < 0 )
+            return false;
+        fd    = _fd;
+        off   = _end;
+        _end += bytes;
+        _runs.push_back( Run{ off, cnt } );
+    }
+    bool ok = pwrite_all( fd, recs.data(), bytes, off );
+    recs.clear();
+    return ok;
+}
+
+void PackSorter::drop_runs() {
+    if ( _fd >= 0 )
+        close(_fd);
+    _fd  = -1;
+    _end = 0;
+    _runs.clear();
+}
+
+// sequential, buffered reader over one spilled run
+class RunReader {
+public:
+    RunReader( int fd, uint64_t off, uint64_t cnt, BoardPacked *buf, size_t cap )
+    : _fd(fd), _left(cnt), _off(off), _buf(buf), _cap(cap), _pos(0), _len(0)
+    {}
+
+    bool empty() const { return _pos == _len && _left == 0; }
+    const BoardPacked& front() const { return _buf[_pos]; }
+
+    // move to the next record, reading more of the run if needed.
+    // false on a read error.
+    bool next() {
+        if ( ++_pos < _len || _left == 0 )
+            return true;
+        return fill();
+    }
+
+    bool fill() {
+        size_t   n     = std::min<uint64_t>( _left, _cap );
+        size_t   bytes = n * sizeof(BoardPacked);
+        uint8_t *p     = _buf[0].b;
+        size_t   done(0);
+        while ( done < bytes ) {
+            ssize_t got = pread( _fd, p + done, bytes - done, _off + done );
+            if ( got <= 0 )
+                return false;
+            done += got;
+        }
+        _off  += bytes;
+        _left -= n;
+        _pos   = 0;
+        _len   = n;
+        return true;
+    }
+
+private:
+    int          _fd;
+    uint64_t     _left;     // records not yet read from the file
+    uint64_t     _off;
+    BoardPacked *_buf;
+    size_t       _cap;
+    size_t       _pos;
+    size_t       _len;
+};
+
+// Merge cnt runs of the run file in order, handing every record to sink.
+// The buffer is cut into cnt + 1 slices - one per run, and one left for
+// the caller to write through.
+bool PackSorter::merge( const Run *runs, size_t cnt, const PackSink& sink ) {
+    size_t                 per = _buf.size() / ( cnt + 1 );
+    std::vector<RunReader> readers;
+    bool                   ok(true);
+    for ( size_t idx(0); idx < cnt; ++idx ) {
+        readers.emplace_back( _fd, runs[idx].off, runs[idx].cnt, _buf.data() + idx * per, per );
+        ok = ok && readers.back().fill();
+    }
+
+    // min-heap of reader indexes, ordered by their current record
+    auto later = [&readers]( size_t a, size_t b ) {
+        return readers[b].front() < readers[a].front();
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap( later );
+    for ( size_t idx(0); ok && idx < readers.size(); ++idx )
+        if ( !readers[idx].empty() )
+            heap.push(idx);
+
+    while ( ok && !heap.empty() ) {
+        size_t idx = heap.top();
+        heap.pop();
+        ok = sink( readers[idx].front() ) && readers[idx].next();
+        if ( ok && !readers[idx].empty() )
+            heap.push(idx);
+    }
+    return ok;
+}
+
+// merge the runs fanin at a time, dropping duplicates, into a new run
+// file that replaces the old
+bool PackSorter::merge_pass( size_t fanin ) {
+    int fd = open_tmp();
+    if ( fd < 0 )
+        return false;
+    std::vector<Run> longer;
+    uint64_t         end(0);
+    bool             ok(true);
+    for ( size_t first(0); ok && first < _runs.size(); first += fanin ) {
+        size_t       cnt = std::min( fanin, _runs.size() - first );
+        size_t       per = _buf.size() / ( cnt + 1 );
+        BoardPacked *out = _buf.data() + cnt * per;
+        size_t       len(0);
+        Run          run{ end, 0 };
+        BoardPacked  last;
+        auto put = [&]( const BoardPacked& rec ) {
+            if ( run.cnt && rec == last )
+                return true;
+            last = rec;
+            if ( len == per ) {
+                if ( !write_all( fd, out, len * sizeof(BoardPacked) ) )
+                    return false;
+                len = 0;
+            }
+            out[len++] = rec;
+            run.cnt++;
+            return true;
+        };
+        ok = merge( &_runs[first], cnt, put )
+          && write_all( fd, out, len * sizeof(BoardPacked) );
+        end += run.cnt * sizeof(BoardPacked);
+        longer.push_back(run);
+    }
+    if ( !ok ) {
+        close(fd);
+        return false;
+    }
+    close(_fd);
+    _fd  = fd;
+    _end = end;
+    _runs.swap(longer);
+    return true;
+}
+
+bool PackSorter::finish( const PackSink& sink ) {
+    bool         ok(true);
+    bool         have_last(false);
+    BoardPacked  last;
+    auto emit = [&]( const BoardPacked& rec ) {
+        if ( have_last && rec == last )
+            return true;
+        last      = rec;
+        have_last = true;
+        _emitted++;
+        return sink(rec);
+    };
+
+    if ( _runs.empty() ) {
+        // everything fit in memory
+        radix_sort( _buf.data(), _buf.size() );
+        for ( auto& rec : _buf )
+            if ( !( ok = emit(rec) ) )
+                break;
+        _buf.clear();
+        return ok;
+    }
+    if ( !_buf.empty() && !spill(_buf) ) {
+        drop_runs();
+        _buf.clear();
+        return false;
+    }
+
+    // no wider than leaves each run a slice of some 64 records (2K)
+    size_t fanin = std::clamp<size_t>( _capacity / 64 - 1, 2, PACKSORT_FANIN );
+    _buf.resize(_capacity);
+    while ( ok && _runs.size() > fanin )
+        ok = merge_pass(fanin);
+    ok = ok && merge( _runs.data(), _runs.size(), emit );
+
+    drop_runs();
+    _buf.clear();
+    _buf.shrink_to_fit();
+    _buf.reserve(_capacity);
+    return ok;
+}
+
+bool PackSorter::finish( PackStoreWriter& w ) {
+    return finish( [&w]( const BoardPacked& rec ) { return w.add(rec); } );
+}
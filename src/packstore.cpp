@@ -0,0 +1,236 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "packstore.h"
+#include "util.h"
+
+static uint64_t page_round( uint64_t off ) {
+    return ( off + PACKSTORE_PAGE - 1 ) & ~uint64_t( PACKSTORE_PAGE - 1 );
+}
+
+PackStore::PackStore()
+: _fd(-1), _map(nullptr), _map_size(0), _cnt(0), _recs(nullptr)
+, _index_cnt(0), _index(nullptr), _blocks(nullptr)
+{}
+
+PackStore::~PackStore() {
+    close();
+}
+
+bool PackStore::open( const std::string& path ) {
+    close();
+    _fd = ::open( path.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        return false;
+
+    struct stat st;
+    if ( fstat( _fd, &st ) != 0 || size_t(st.st_size) < sizeof(PackStoreHeader) ) {
+        close();
+        return false;
+    }
+    _map_size = st.st_size;
+    void *map = mmap( nullptr, _map_size, PROT_READ, MAP_SHARED, _fd, 0 );
+    if ( map == MAP_FAILED ) {
+        _map_size = 0;
+        close();
+        return false;
+    }
+    _map = static_cast<uint8_t *>(map);
+
+    const PackStoreHeader *hdr = reinterpret_cast<const PackStoreHeader *>(_map);
+    if ( std::memcmp( hdr->magic, PACKSTORE_MAGIC, sizeof(hdr->magic) ) != 0
+      || hdr->version != PACKSTORE_VERSION
+      || hdr->record_size != sizeof(BoardPacked)
+      || hdr->record_off + hdr->record_cnt * sizeof(BoardPacked) > _map_size
+      || ( hdr->index_off && hdr->index_off + hdr->index_cnt * ( sizeof(BoardPacked) + sizeof(uint64_t) ) > _map_size ) ) {
+        close();
+        return false;
+    }
+    _cnt  = hdr->record_cnt;
+    _recs = reinterpret_cast<const BoardPacked *>( _map + hdr->record_off );
+    if ( hdr->index_off && hdr->block_records == PACKSTORE_BLOCK ) {
+        _index_cnt = hdr->index_cnt;
+        // entry 0 is unused so the Eytzinger arithmetic can be 1-based
+        _index     = reinterpret_cast<const BoardPacked *>( _map + hdr->index_off ) - 1;
+        _blocks    = reinterpret_cast<const uint64_t *>( _map + hdr->index_off + _index_cnt * sizeof(BoardPacked) ) - 1;
+    }
+    // records are found by search, not read in order
+    madvise( _map, _map_size, MADV_RANDOM );
+    return true;
+}
+
+void PackStore::close() {
+    if ( _map )
+        munmap( _map, _map_size );
+    if ( _fd >= 0 )
+        ::close(_fd);
+    _fd        = -1;
+    _map       = nullptr;
+    _map_size  = 0;
+    _cnt       = 0;
+    _recs      = nullptr;
+    _index_cnt = 0;
+    _index     = nullptr;
+    _blocks    = nullptr;
+}
+
+bool PackStore::is_open() const { return _map != nullptr; }
+uint64_t PackStore::size() const { return _cnt; }
+bool PackStore::has_index() const { return _index != nullptr; }
+const BoardPacked& PackStore::operator[]( uint64_t idx ) const { return _recs[idx]; }
+const BoardPacked *PackStore::begin() const { return _recs; }
+const BoardPacked *PackStore::end() const { return _recs + _cnt; }
+
+int64_t PackStore::find_block( const BoardPacked& key ) const {
+    // descend to the first index key greater than key. Going right means
+    // appending a 1 bit to k, so once k falls off the bottom, stripping
+    // the trailing 1s and the 0 before them gives the node where the
+    // search last went left - that first greater key.
+    uint64_t k(1);
+    while ( k <= _index_cnt ) {
+        __builtin_prefetch( _index + 4 * k );
+        k = 2 * k + !( key < _index[k] );
+    }
+    k >>= __builtin_ctzll( ~k ) + 1;
+    if ( k == 0 )
+        return int64_t( _index_cnt ) - 1;   // key is past every block's first
+    return int64_t( _blocks[k] ) - 1;
+}
+
+uint64_t PackStore::lower_bound( const BoardPacked& key ) const {
+    const BoardPacked *lo = _recs;
+    const BoardPacked *hi = _recs + _cnt;
+    if ( _index ) {
+        int64_t blk = find_block(key);
+        if ( blk < 0 )
+            return 0;
+        lo = _recs + blk * PACKSTORE_BLOCK;
+        hi = std::min( lo + PACKSTORE_BLOCK, _recs + _cnt );
+    }
+    return std::lower_bound( lo, hi, key ) - _recs;
+}
+
+bool PackStore::find( const BoardPacked& key, uint64_t& idx ) const {
+    idx = lower_bound(key);
+    return idx < _cnt && _recs[idx] == key;
+}
+
+bool PackStore::contains( const BoardPacked& key ) const {
+    uint64_t idx;
+    return find( key, idx );
+}
+
+PackStoreWriter::PackStoreWriter()
+: _fd(-1), _with_index(true), _ok(false), _cnt(0)
+{}
+
+PackStoreWriter::~PackStoreWriter() {
+    if ( _fd >= 0 )
+        ::close(_fd);
+}
+
+bool PackStoreWriter::open( const std::string& path, bool with_index ) {
+    if ( _fd >= 0 )
+        close();
+    _fd = ::open( path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644 );
+    if ( _fd < 0 )
+        return false;
+    _with_index = with_index;
+    _ok         = lseek( _fd, PACKSTORE_PAGE, SEEK_SET ) == PACKSTORE_PAGE;
+    _cnt        = 0;
+    _buf.clear();
+    _buf.reserve( 1 << 15 );
+    _firsts.clear();
+    return _ok;
+}
+
+bool PackStoreWriter::add( const BoardPacked& rec ) {
+    if ( !_ok || ( _cnt && !( _last < rec ) ) )
+        return false;
+    if ( _with_index && _cnt % PACKSTORE_BLOCK == 0 )
+        _firsts.push_back(rec);
+    _buf.push_back(rec);
+    _last = rec;
+    _cnt++;
+    if ( _buf.size() == _buf.capacity() )
+        return flush();
+    return true;
+}
+
+bool PackStoreWriter::add( const BoardPacked *recs, size_t cnt ) {
+    for ( size_t idx(0); idx < cnt; ++idx )
+        if ( !add( recs[idx] ) )
+            return false;
+    return true;
+}
+
+bool PackStoreWriter::flush() {
+    _ok = _ok && write_all( _fd, _buf.data(), _buf.size() * sizeof(BoardPacked) );
+    _buf.clear();
+    return _ok;
+}
+
+// fill eytz[1..n] with sorted[0..n) in Eytzinger order, recording the
+// sorted position of each
+static uint64_t eytzinger( const std::vector<BoardPacked>& sorted, std::vector<BoardPacked>& eytz,
+                           std::vector<uint64_t>& blocks, uint64_t i, uint64_t k ) {
+    if ( k < eytz.size() ) {
+        i = eytzinger( sorted, eytz, blocks, i, 2 * k );
+        eytz[k]   = sorted[i];
+        blocks[k] = i++;
+        i = eytzinger( sorted, eytz, blocks, i, 2 * k + 1 );
+    }
+    return i;
+}
+
+bool PackStoreWriter::close() {
+    if ( _fd < 0 )
+        return false;
+    flush();
+
+    PackStoreHeader hdr;
+    std::memset( &hdr, 0, sizeof(hdr) );
+    std::memcpy( hdr.magic, PACKSTORE_MAGIC, sizeof(hdr.magic) );
+    hdr.version       = PACKSTORE_VERSION;
+    hdr.record_size   = sizeof(BoardPacked);
+    hdr.record_cnt    = _cnt;
+    hdr.record_off    = PACKSTORE_PAGE;
+    hdr.block_records = PACKSTORE_BLOCK;
+
+    if ( _ok && _with_index && !_firsts.empty() ) {
+        uint64_t n = _firsts.size();
+        std::vector<BoardPacked> eytz( n + 1 );
+        std::vector<uint64_t>    blocks( n + 1 );
+        eytzinger( _firsts, eytz, blocks, 0, 1 );
+        hdr.index_off = page_round( PACKSTORE_PAGE + _cnt * sizeof(BoardPacked) );
+        hdr.index_cnt = n;
+        _ok = lseek( _fd, hdr.index_off, SEEK_SET ) == off_t(hdr.index_off)
+           && write_all( _fd, eytz.data() + 1, n * sizeof(BoardPacked) )
+           && write_all( _fd, blocks.data() + 1, n * sizeof(uint64_t) );
+    }
+    // an empty store still has its (empty) record page
+    if ( _ok && !hdr.index_off && _cnt == 0 )
+        _ok = ftruncate( _fd, PACKSTORE_PAGE ) == 0;
+    _ok = _ok && pwrite( _fd, &hdr, sizeof(hdr), 0 ) == sizeof(hdr);
+    _ok = ( ::close(_fd) == 0 ) && _ok;
+    _fd = -1;
+    _firsts.clear();
+    _firsts.shrink_to_fit();
+    return _ok;
+}
+
+uint64_t PackStoreWriter::count() const { return _cnt; }
+
+bool PackStoreWriter::write( const std::string& path, BoardPackedList& recs, bool with_index ) {
+    std::sort( recs.begin(), recs.end() );
+    recs.erase( std::unique( recs.begin(), recs.end() ), recs.end() );
+    PackStoreWriter w;
+    return w.open( path, with_index )
+        && w.add( recs.data(), recs.size() )
+        && w.close();
+}
@@ -0,0 +1,150 @@
+#include "perft.h"
+
+// Published counts - see https://www.chessprogramming.org/Perft_Results
+// and the en passant/castling/promotion edge cases collected by Peter
+// Jones (https://gist.github.com/peterellisjones/8c46c28141c162d1d8a0f0badbc9b5c8)
+const PerftPosition perft_positions[] = {
+    { "initial",        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      { 20, 400, 8902, 197281, 4865609, 119060324, 3195901860ULL, 0 } },
+    { "kiwipete",       "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690, 8031647685ULL, 0, 0 } },
+    { "position 3",     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624, 11030083, 178633661, 3009794393ULL } },
+    { "position 4",     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292, 706045033, 0, 0 } },
+    { "position 4 mirrored", "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+      { 6, 264, 9467, 422333, 15833292, 706045033, 0, 0 } },
+    { "position 5",     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194, 0, 0, 0 } },
+    { "position 6",     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551, 6923051137ULL, 0, 0 } },
+    { "illegal ep 1",   "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+      { 0, 0, 0, 0, 0, 1134888, 0, 0 } },
+    { "illegal ep 2",   "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",
+      { 0, 0, 0, 0, 0, 1015133, 0, 0 } },
+    { "ep gives check", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+      { 0, 0, 0, 0, 0, 1440467, 0, 0 } },
+    { "short castle gives check", "5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+      { 0, 0, 0, 0, 0, 661072, 0, 0 } },
+    { "long castle gives check",  "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+      { 0, 0, 0, 0, 0, 803711, 0, 0 } },
+    { "castle rights",  "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+      { 0, 0, 0, 1274206, 0, 0, 0, 0 } },
+    { "castle prevented", "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+      { 0, 0, 0, 1720476, 0, 0, 0, 0 } },
+    { "promote out of check", "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
+      { 0, 0, 0, 0, 0, 3821001, 0, 0 } },
+    { "discovered check", "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",
+      { 0, 0, 0, 0, 1004658, 0, 0, 0 } },
+    { "promote to give check", "4k3/1P6/8/8/8/8/K7/8 w - - 0 1",
+      { 0, 0, 0, 0, 0, 217342, 0, 0 } },
+    { "underpromote to give check", "8/P1k5/K7/8/8/8/8/8 w - - 0 1",
+      { 0, 0, 0, 0, 0, 92683, 0, 0 } },
+    { "self stalemate", "K1k5/8/P7/8/8/8/8/8 w - - 0 1",
+      { 0, 0, 0, 0, 0, 2217, 0, 0 } },
+    { "stalemate and checkmate 1", "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
+      { 0, 0, 0, 0, 0, 0, 567584, 0 } },
+    { "stalemate and checkmate 2", "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1",
+      { 0, 0, 0, 23527, 0, 0, 0, 0 } },
+};
+
+const int perft_position_cnt = sizeof(perft_positions) / sizeof(perft_positions[0]);
+
+// true if mov does not leave the mover's own king in check
+static bool is_legal( Board& b, MovePacked mov ) {
+    Side     s = b.get_on_move();
+    MoveUndo undo;
+    b.make_move( mov, undo );
+    bool ok = b.test_for_check(s) == 0;
+    b.unmake_move( mov, undo );
+    return ok;
+}
+
+int count_legal( Board& b, const MoveArray& moves ) {
+    int cnt(0);
+    for ( auto mov : moves )
+        if ( is_legal( b, mov ) )
+            cnt++;
+    return cnt;
+}
+
+uint64_t perft( Board& b, int depth, bool bulk ) {
+    if ( depth <= 0 )
+        return 1;
+
+    MoveArray moves;
+    b.get_legal_moves(moves);
+    if ( bulk && depth == 1 )
+        return moves.size();
+
+    uint64_t nodes(0);
+    for ( auto mov : moves ) {
+        MoveUndo undo;
+        b.make_move( mov, undo );
+        nodes += perft( b, depth - 1, bulk );
+        b.unmake_move( mov, undo );
+    }
+    return nodes;
+}
+
+uint64_t perft_hashed( Board& b, int depth, PerftTable& tt, bool bulk ) {
+    if ( depth <= 0 )
+        return 1;
+
+    uint64_t nodes(0);
+    if ( tt.probe( b.key(), depth, nodes ) )
+        return nodes;
+
+    MoveArray moves;
+    b.get_legal_moves(moves);
+    if ( bulk && depth == 1 ) {
+        nodes = moves.size();
+    } else {
+        for ( auto mov : moves ) {
+            MoveUndo undo;
+            b.make_move( mov, undo );
+            nodes += perft_hashed( b, depth - 1, tt, bulk );
+            b.unmake_move( mov, undo );
+        }
+    }
+    tt.store( b.key(), depth, nodes );
+    return nodes;
+}
+
+uint64_t perft_divide( Board& b, int depth, std::ostream& os, bool bulk ) {
+    if ( depth <= 0 )
+        return 1;
+
+    MoveArray moves;
+    b.get_legal_moves(moves);
+
+    uint64_t nodes(0);
+    for ( auto mov : moves ) {
+        MoveUndo undo;
+        b.make_move( mov, undo );
+        uint64_t cnt = perft( b, depth - 1, bulk );
+        os << move_text(mov) << ": " << cnt << std::endl;
+        nodes += cnt;
+        b.unmake_move( mov, undo );
+    }
+    return nodes;
+}
+
+std::string move_text( MovePacked mov ) {
+    Square org( RnF(mov.f.source) );
+    Square dst( RnF(mov.f.target) );
+    // castles are recorded king-to-rook, but are written as the king's move
+    if ( mov.f.action == MV_CASTLE_KINGSIDE )
+        dst = Square( org.rank(), Fg );
+    else if ( mov.f.action == MV_CASTLE_QUEENSIDE )
+        dst = Square( org.rank(), Fc );
+
+    std::string ret = org.to_string() + dst.to_string();
+    switch ( mov.f.action ) {
+        case MV_PROM_QUEEN:  ret += 'q'; break;
+        case MV_PROM_BISHOP: ret += 'b'; break;
+        case MV_PROM_KNIGHT: ret += 'n'; break;
+        case MV_PROM_ROOK:   ret += 'r'; break;
+    }
+    return ret;
+}
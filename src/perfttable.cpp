@@ -0,0 +1,63 @@
+#include "perfttable.h"
+
+PerftTable::PerftTable(size_t mb) {
+    uint64_t cnt = ( uint64_t(mb) << 20 ) / sizeof(Bucket);
+    // round down to a power of two so the bucket is a simple mask
+    uint64_t pow2(1);
+    while ( pow2 * 2 <= cnt )
+        pow2 *= 2;
+    _mask    = pow2 - 1;
+    _buckets = std::make_unique<Bucket[]>(pow2);
+    clear();
+}
+
+size_t PerftTable::size_bytes() const {
+    return ( _mask + 1 ) * sizeof(Bucket);
+}
+
+void PerftTable::clear() {
+    for ( uint64_t idx(0); idx <= _mask; ++idx ) {
+        for ( auto& e : _buckets[idx].entries ) {
+            e.check.store( 0, std::memory_order_relaxed );
+            e.data.store( 0, std::memory_order_relaxed );
+        }
+    }
+}
+
+bool PerftTable::probe(uint64_t key, int depth, uint64_t& nodes) const {
+    const Bucket& b = _buckets[ key & _mask ];
+    for ( auto& e : b.entries ) {
+        uint64_t data  = e.data.load( std::memory_order_relaxed );
+        uint64_t check = e.check.load( std::memory_order_relaxed );
+        if ( ( check ^ data ) == key && int( data & 0xff ) == depth && data != 0 ) {
+            nodes = data >> 8;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerftTable::store(uint64_t key, int depth, uint64_t nodes) {
+    Bucket&  b    = _buckets[ key & _mask ];
+    uint64_t data = ( nodes << 8 ) | uint64_t( depth & 0xff );
+
+    // replace the same position at the same depth if present, otherwise
+    // the shallowest - and so cheapest to recompute - entry.
+    Entry *victim = &b.entries[0];
+    int    lowest = 256;
+    for ( auto& e : b.entries ) {
+        uint64_t edata = e.data.load( std::memory_order_relaxed );
+        uint64_t check = e.check.load( std::memory_order_relaxed );
+        int      edep  = int( edata & 0xff );
+        if ( ( check ^ edata ) == key && edep == depth ) {
+            victim = &e;
+            break;
+        }
+        if ( edep < lowest ) {
+            lowest = edep;
+            victim = &e;
+        }
+    }
+    victim->check.store( key ^ data, std::memory_order_relaxed );
+    victim->data.store( data, std::memory_order_relaxed );
+}
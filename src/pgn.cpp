@@ -0,0 +1,424 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+#include "pgn.h"
+
+static bool is_space( char ch ) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+static const char *skip_line( const char *p, const char *end ) {
+    const char *nl = static_cast<const char *>( std::memchr( p, '\n', end - p ) );
+    return ( nl ) ? nl + 1 : end;
+}
+
+// true if the line at p opens a tag pair - a '[' then a tag name, which
+// sets it apart from a wrapped comment line such as "[%clk 0:03:00] }"
+static bool is_tag_line( const char *p, const char *end ) {
+    return end - p > 1 && p[0] == '[' && std::isalpha( static_cast<unsigned char>( p[1] ) );
+}
+
+// true if the brace at p sits in a ';' comment running to the end of
+// its line
+static bool in_line_comment( const char *beg, const char *p ) {
+    for ( const char *c = p; c > beg && c[-1] != '\n'; --c )
+        if ( c[-1] == ';' )
+            return true;
+    return false;
+}
+
+// true if q lies within a '{' comment opened before it. The look back
+// stops at the previous tag line, so it covers at most one movetext.
+static bool in_comment( const char *beg, const char *q ) {
+    for ( const char *p = q; p > beg; ) {
+        --p;
+        if ( ( *p == '{' || *p == '}' ) && !in_line_comment( beg, p ) )
+            return *p == '{';
+        if ( *p == '[' && ( p == beg || p[-1] == '\n' ) && is_tag_line( p, q ) )
+            return false;
+    }
+    return false;
+}
+
+// true if the tag line at q begins a game - that is, the last line before
+// it that isn't blank is not a tag, or there is none, and q is not part
+// of a comment
+static bool is_game_start( const char *beg, const char *q, const char *end ) {
+    const char *p = q;
+    while ( p > beg ) {
+        const char *eol = p - 1;        // the '\n' ending the previous line
+        const char *sol = eol;
+        while ( sol > beg && sol[-1] != '\n' )
+            --sol;
+        const char *c = sol;
+        while ( c < eol && is_space(*c) )
+            ++c;
+        if ( c < eol )
+            return !is_tag_line( c, end ) && !in_comment( beg, q );
+        p = sol;
+    }
+    return true;
+}
+
+// the start of the first game at or after from, or end if none
+static const char *next_game( const char *beg, const char *from, const char *end ) {
+    const char *p = from;
+    if ( p > beg && p[-1] != '\n' )
+        p = skip_line( p, end );
+    for ( ; p < end; p = skip_line( p, end ) )
+        if ( is_tag_line( p, end ) && is_game_start( beg, p, end ) )
+            return p;
+    return end;
+}
+
+// the piece type named by a SAN piece letter, PT_EMPTY if none
+static PieceType san_piece( char ch ) {
+    switch ( ch ) {
+    case 'K': return PT_KING;
+    case 'Q': return PT_QUEEN;
+    case 'R': return PT_ROOK;
+    case 'B': return PT_BISHOP;
+    case 'N': return PT_KNIGHT;
+    }
+    return PT_EMPTY;
+}
+
+static MoveAction san_promotion( char ch ) {
+    switch ( ch ) {
+    case 'Q': return MV_PROM_QUEEN;
+    case 'R': return MV_PROM_ROOK;
+    case 'B': return MV_PROM_BISHOP;
+    case 'N': return MV_PROM_KNIGHT;
+    }
+    return MV_NONE;
+}
+
+bool resolve_san( const Board& b, std::string_view san, MovePacked& mov ) {
+    // annotation marks tell us nothing about which move it is
+    while ( !san.empty() && san.back() && std::strchr( "+#!?", san.back() ) )
+        san.remove_suffix(1);
+
+    MoveArray legal;
+    b.get_legal_moves(legal);
+
+    if ( san.substr( 0, 3 ) == "O-O" || san.substr( 0, 3 ) == "0-0" ) {
+        MoveAction action = ( san.size() >= 5 ) ? MV_CASTLE_QUEENSIDE : MV_CASTLE_KINGSIDE;
+        for ( auto m : legal )
+            if ( m.f.action == action ) {
+                mov = m;
+                return true;
+            }
+        return false;
+    }
+
+    PieceType  piece = PT_PAWN;
+    MoveAction promo = MV_NONE;
+    if ( !san.empty() && san_piece( san[0] ) != PT_EMPTY ) {
+        piece = san_piece( san[0] );
+        san.remove_prefix(1);
+    } else if ( !san.empty() && san_promotion( san.back() ) != MV_NONE ) {
+        promo = san_promotion( san.back() );
+        san.remove_suffix(1);
+        if ( !san.empty() && san.back() == '=' )
+            san.remove_suffix(1);
+    }
+    size_t n = san.size();
+    if ( n < 2 || san[n - 2] < 'a' || san[n - 2] > 'h' || san[n - 1] < '1' || san[n - 1] > '8' )
+        return false;
+    int dst       = RNF( san[n - 1] - '1', san[n - 2] - 'a' );
+    int from_file = -1;
+    int from_rank = -1;
+    for ( size_t i(0); i < n - 2; ++i ) {
+        char ch = san[i];
+        if ( ch >= 'a' && ch <= 'h' )
+            from_file = ch - 'a';
+        else if ( ch >= '1' && ch <= '8' )
+            from_rank = ch - '1';
+        else if ( ch != 'x' && ch != '-' && ch != ':' )
+            return false;
+    }
+
+    int found(0);
+    for ( auto m : legal ) {
+        int org = m.f.source;
+        if ( m.f.target != dst
+          || m.f.action == MV_CASTLE_KINGSIDE || m.f.action == MV_CASTLE_QUEENSIDE
+          || ( from_file >= 0 && sq_file(org) != from_file )
+          || ( from_rank >= 0 && sq_rank(org) != from_rank ) )
+            continue;
+        PieceType pt = b.type_at( Square( RnF(org) ) );
+        if ( pt == PT_PAWN_OFF )
+            pt = PT_PAWN;
+        if ( pt != piece )
+            continue;
+        if ( ( promo != MV_NONE ) ? m.f.action != promo : m.f.action >= MV_PROM_QUEEN )
+            continue;
+        mov = m;
+        found++;
+    }
+    return found == 1;
+}
+
+PgnGame::PgnGame()
+: index(0), offset(0), start(false), error(nullptr)
+{}
+
+std::string_view PgnGame::tag( std::string_view name ) const {
+    const char *p   = text.data();
+    const char *end = p + text.size();
+    while ( p < end ) {
+        while ( p < end && is_space(*p) )
+            ++p;
+        if ( !is_tag_line( p, end ) )
+            break;      // past the tags
+        const char *eol = static_cast<const char *>( std::memchr( p, '\n', end - p ) );
+        if ( !eol )
+            eol = end;
+        std::string_view line( p + 1, eol - p - 1 );
+        if ( line.substr( 0, name.size() ) == name && line.size() > name.size() && is_space( line[name.size()] ) ) {
+            size_t open  = line.find('"');
+            size_t close = open;
+            do {
+                close = line.find( '"', close + 1 );
+            } while ( close != std::string_view::npos && line[close - 1] == '\\' );
+            if ( open != std::string_view::npos && close != std::string_view::npos )
+                return line.substr( open + 1, close - open - 1 );
+        }
+        p = eol;
+    }
+    return std::string_view();
+}
+
+void PgnGame::positions( BoardPackedList& out, bool identity ) const {
+    Board    b(start);
+    MoveUndo undo;
+    out.push_back( ( identity ) ? b.pack_identity() : b.pack() );
+    for ( auto mov : moves ) {
+        b.make_move( mov, undo );
+        out.push_back( ( identity ) ? b.pack_identity() : b.pack() );
+    }
+}
+
+// the end of the comment, variation or line that starts at p. open is
+// set if a comment or variation is still open at end.
+static const char *skip_aside( const char *p, const char *end, bool& open ) {
+    if ( *p == '{' ) {
+        const char *close = static_cast<const char *>( std::memchr( p, '}', end - p ) );
+        open = open || !close;
+        return ( close ) ? close + 1 : end;
+    }
+    if ( *p == ';' || *p == '%' )
+        return skip_line( p, end );
+    // a variation, which may nest and hold comments
+    int depth(0);
+    while ( p < end ) {
+        if ( *p == '{' || *p == ';' ) {
+            p = skip_aside( p, end, open );
+            continue;
+        }
+        if ( *p == '(' )
+            depth++;
+        else if ( *p == ')' && --depth == 0 )
+            return p + 1;
+        p++;
+    }
+    open = true;
+    return end;
+}
+
+// the characters that end a movetext token other than space - each
+// starts (or wrongly closes) something the token is not part of
+static bool is_token_end( char ch ) {
+    switch ( ch ) {
+    case '{': case '}': case '(': case ')': case ';': case '$':
+        return true;
+    }
+    return false;
+}
+
+static bool is_result( std::string_view tok ) {
+    return tok == "1-0" || tok == "0-1" || tok == "1/2-1/2" || tok == "*";
+}
+
+// parse the game in [g, end) into game
+static void parse_game( const char *g, const char *end, PgnGame& game ) {
+    while ( end > g && is_space( end[-1] ) )
+        --end;
+    game.text = std::string_view( g, end - g );
+
+    // the tags come first, one to a line
+    const char *p = g;
+    while ( p < end ) {
+        while ( p < end && is_space(*p) )
+            ++p;
+        if ( !is_tag_line( p, end ) )
+            break;
+        p = skip_line( p, end );
+    }
+
+    std::string_view fen = game.tag("FEN");
+    if ( fen.empty() ) {
+        game.start.set_initial_position();
+    } else if ( !game.start.parse_fen(fen) ) {
+        game.error = "bad FEN tag";
+        game.bad   = fen;
+        return;
+    }
+
+    Board      b(game.start);
+    MoveUndo   undo;
+    MovePacked mov;
+    while ( p < end ) {
+        char ch = *p;
+        if ( is_space(ch) ) {
+            p++;
+        } else if ( ch == '{' || ch == ';' || ch == '(' || ( ch == '%' && ( p == g || p[-1] == '\n' ) ) ) {
+            bool open(false);
+            const char *s = p;
+            p = skip_aside( p, end, open );
+            if ( open ) {
+                game.error = ( ch == '(' ) ? "unterminated variation" : "unterminated comment";
+                game.bad   = std::string_view( s, 1 );
+                return;
+            }
+        } else if ( ch == '$' ) {
+            // numeric annotation glyph
+            for ( p++; p < end && *p >= '0' && *p <= '9'; ++p )
+                ;
+        } else if ( ch == ')' || ch == '}' ) {
+            // closes nothing that is open
+            game.error = "unbalanced variation or comment";
+            game.bad   = std::string_view( p, 1 );
+            return;
+        } else {
+            const char *s = p;
+            while ( p < end && !is_space(*p) && !is_token_end(*p) )
+                ++p;
+            std::string_view tok( s, p - s );
+            if ( tok.empty() ) {
+                // can't happen - every delimiter is dealt with above - but a
+                // token that doesn't move p must never loop
+                game.error = "unexpected character";
+                game.bad   = std::string_view( p, 1 );
+                return;
+            }
+            if ( is_result(tok) ) {
+                game.result = tok;
+                break;
+            }
+            // a move number, perhaps run into its move ("12.e4")
+            if ( tok[0] >= '1' && tok[0] <= '9' ) {
+                size_t i(0);
+                while ( i < tok.size() && tok[i] >= '0' && tok[i] <= '9' )
+                    i++;
+                while ( i < tok.size() && tok[i] == '.' )
+                    i++;
+                tok.remove_prefix(i);
+            } else if ( tok[0] == '.' ) {
+                continue;
+            }
+            if ( tok.empty() )
+                continue;
+            if ( !resolve_san( b, tok, mov ) ) {
+                game.error = "illegal or ambiguous move";
+                game.bad   = tok;
+                return;
+            }
+            b.make_move( mov, undo );
+            game.moves.push_back(mov);
+        }
+    }
+}
+
+PgnFile::PgnFile()
+: _fd(-1), _map(nullptr), _size(0)
+{}
+
+PgnFile::~PgnFile() {
+    close();
+}
+
+bool PgnFile::open( const std::string& path ) {
+    close();
+    _fd = ::open( path.c_str(), O_RDONLY );
+    if ( _fd < 0 )
+        return false;
+    struct stat st;
+    if ( fstat( _fd, &st ) != 0 ) {
+        close();
+        return false;
+    }
+    _size = st.st_size;
+    if ( _size == 0 )
+        return true;
+    void *map = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+    if ( map == MAP_FAILED ) {
+        close();
+        return false;
+    }
+    _map = static_cast<const char *>(map);
+    madvise( const_cast<char *>(_map), _size, MADV_SEQUENTIAL );
+    return true;
+}
+
+void PgnFile::close() {
+    if ( _map )
+        munmap( const_cast<char *>(_map), _size );
+    if ( _fd >= 0 )
+        ::close(_fd);
+    _fd   = -1;
+    _map  = nullptr;
+    _size = 0;
+}
+
+bool   PgnFile::is_open() const { return _fd >= 0; }
+size_t PgnFile::bytes() const   { return _size; }
+
+uint64_t PgnFile::read( ThreadPool& pool, const PgnSink& sink, size_t batch ) const {
+    const char *end = _map + _size;
+    const char *p   = ( _map ) ? next_game( _map, _map, end ) : end;
+    uint64_t    cnt(0);
+    batch = std::max<size_t>( batch, PGN_CHUNK );
+    while ( p < end ) {
+        // a batch ends at a game boundary, and holds at least one game
+        const char *stop = p + std::min<size_t>( batch, end - p );
+        stop = next_game( _map, stop, end );
+        if ( stop == p )
+            stop = next_game( _map, p + 1, end );
+
+        size_t chunks = ( stop - p + PGN_CHUNK - 1 ) / PGN_CHUNK;
+        std::vector<std::vector<PgnGame>> games( chunks );
+        {
+            TaskGroup grp(pool);
+            for ( size_t k(0); k < chunks; ++k )
+                grp.run( [&, k]{
+                    const char *a = p + k * PGN_CHUNK;
+                    const char *b = std::min( a + PGN_CHUNK, stop );
+                    const char *g = ( k == 0 ) ? p : next_game( _map, a, stop );
+                    while ( g < b ) {
+                        const char *n = next_game( _map, g + 1, stop );
+                        games[k].emplace_back();
+                        games[k].back().offset = g - _map;
+                        parse_game( g, n, games[k].back() );
+                        g = n;
+                    }
+                } );
+            grp.wait();
+        }
+        for ( auto& chunk : games )
+            for ( auto& game : chunk ) {
+                game.index = cnt++;
+                if ( !sink(game) )
+                    return cnt;
+            }
+        p = stop;
+    }
+    return cnt;
+}
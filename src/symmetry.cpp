@@ -0,0 +1,60 @@
+// position symmetries
+#include "constants.h"
+#include "board.h"
+
+// Mirroring flips the file bits of a square index, and flipping the
+// rank bits. A flip also swaps each piece's color.
+Board Board::transformed( BoardTransform t ) const {
+    int     sq_xor = ( ( t & BT_MIRROR ) ? 0x07 : 0 ) | ( ( t & BT_FLIP ) ? 0x38 : 0 );
+    uint8_t by_xor = ( t & BT_FLIP ) ? 0x08 : 0;
+
+    Board ret(false);
+    Bitboard bb = occupied();
+    while ( bb ) {
+        int idx = bb_pop(bb);
+        ret.put_byte( idx ^ sq_xor, _mailbox[idx] ^ by_xor );
+    }
+
+    if ( t & BT_FLIP ) {
+        ret._on_move                = OTHER_SIDE(_on_move);
+        ret._castle_white_queenside = _castle_black_queenside;
+        ret._castle_white_kingside  = _castle_black_kingside;
+        ret._castle_black_queenside = _castle_white_queenside;
+        ret._castle_black_kingside  = _castle_white_kingside;
+    } else {
+        ret._on_move                = _on_move;
+        ret._castle_white_queenside = _castle_white_queenside;
+        ret._castle_white_kingside  = _castle_white_kingside;
+        ret._castle_black_queenside = _castle_black_queenside;
+        ret._castle_black_kingside  = _castle_black_kingside;
+    }
+    if ( has_en_passant() )
+        ret._en_passant = Square( RnF( _en_passant.rnf() ^ sq_xor ) );
+    ret._half_move_clock = _half_move_clock;
+    ret._full_move_cnt   = _full_move_cnt;
+    ret._key             = ret.compute_key();
+    return ret;
+}
+
+BoardPacked Board::pack_canonical( BoardTransform *used ) const {
+    // mirroring would move the kings and rooks off their castling squares
+    bool           can_mirror = !side_can_castle(SIDE_WHITE) && !side_can_castle(SIDE_BLACK);
+    BoardPacked    best       = pack();
+    BoardTransform best_t     = BT_IDENTITY;
+    for ( auto t : { BT_MIRROR, BT_FLIP, BT_MIRROR_FLIP } ) {
+        if ( ( t & BT_MIRROR ) && !can_mirror )
+            continue;
+        BoardPacked bp = transformed(t).pack();
+        if ( bp < best ) {
+            best   = bp;
+            best_t = t;
+        }
+    }
+    if ( used )
+        *used = best_t;
+    return best;
+}
+
+BoardPacked Board::canonical( const BoardPacked& pack, BoardTransform *used ) {
+    return Board(pack).pack_canonical(used);
+}
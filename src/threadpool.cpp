@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "threadpool.h"
+
+// the pool and worker index of the current thread, if it is a worker
+static thread_local ThreadPool *tl_pool         = nullptr;
+static thread_local int         tl_worker_index = -1;
+
+ThreadPool::ThreadPool(unsigned threads)
+: _stop(false), _pending(0), _next(0)
+{
+    if ( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    for ( unsigned idx(0); idx < threads; ++idx )
+        _queues.push_back( std::make_unique<Queue>() );
+    for ( unsigned idx(0); idx < threads; ++idx )
+        _threads.emplace_back( &ThreadPool::worker, this, idx );
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for ( auto& thr : _threads )
+        thr.join();
+}
+
+unsigned ThreadPool::size() const {
+    return _queues.size();
+}
+
+int ThreadPool::worker_index() {
+    return tl_worker_index;
+}
+
+void ThreadPool::submit(Task task) {
+    unsigned idx = ( tl_pool == this ) ? tl_worker_index : _next++ % _queues.size();
+    {
+        std::lock_guard<std::mutex> lk(_queues[idx]->mtx);
+        _queues[idx]->tasks.push_back( std::move(task) );
+    }
+    _pending++;
+    // take the lock so a worker between checking _pending and waiting
+    // cannot miss the notification.
+    { std::lock_guard<std::mutex> lk(_mtx); }
+    _cv.notify_one();
+}
+
+bool ThreadPool::run_one() {
+    Task     task;
+    unsigned self = ( tl_pool == this ) ? tl_worker_index : _next % _queues.size();
+    if ( !pop(self, task) && !steal(self, task) )
+        return false;
+    _pending--;
+    task();
+    return true;
+}
+
+// newest task from our own queue
+bool ThreadPool::pop(unsigned idx, Task& task) {
+    Queue& q = *_queues[idx];
+    std::lock_guard<std::mutex> lk(q.mtx);
+    if ( q.tasks.empty() )
+        return false;
+    task = std::move( q.tasks.back() );
+    q.tasks.pop_back();
+    return true;
+}
+
+// oldest task from anyone else's queue
+bool ThreadPool::steal(unsigned idx, Task& task) {
+    unsigned cnt = _queues.size();
+    for ( unsigned off(1); off <= cnt; ++off ) {
+        Queue& q = *_queues[ ( idx + off ) % cnt ];
+        std::lock_guard<std::mutex> lk(q.mtx);
+        if ( q.tasks.empty() )
+            continue;
+        task = std::move( q.tasks.front() );
+        q.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker(unsigned idx) {
+    tl_pool         = this;
+    tl_worker_index = idx;
+    while ( true ) {
+        if ( run_one() )
+            continue;
+        std::unique_lock<std::mutex> lk(_mtx);
+        _cv.wait( lk, [this]{ return _stop || _pending > 0; } );
+        if ( _stop )
+            break;
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+: _pool(pool), _cnt(0)
+{}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(ThreadPool::Task task) {
+    _cnt++;
+    _pool.submit( [this, task]{
+        task();
+        _cnt--;
+    } );
+}
+
+void TaskGroup::wait() {
+    while ( _cnt > 0 ) {
+        if ( !_pool.run_one() )
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,101 @@
+#include <atomic>
+
+#include "perft.h"
+#include "treewalk.h"
+
+static int worker_slot( ThreadPool& pool ) {
+    int idx = ThreadPool::worker_index();
+    return ( idx < 0 ) ? pool.size() : idx;
+}
+
+// walk the subtree below b on the calling thread
+static uint64_t walk_serial( Board& b, int ply, int depth, const NodeVisitor& visit, int worker ) {
+    visit( b, ply, worker );
+    if ( ply == depth )
+        return 1;
+
+    uint64_t  cnt(1);
+    MoveArray moves;
+    b.get_legal_moves(moves);
+    for ( auto mov : moves ) {
+        MoveUndo undo;
+        b.make_move( mov, undo );
+        cnt += walk_serial( b, ply + 1, depth, visit, worker );
+        b.unmake_move( mov, undo );
+    }
+    return cnt;
+}
+
+struct WalkJob {
+    ThreadPool&            pool;
+    TaskGroup&             grp;
+    const NodeVisitor&     visit;
+    int                    depth;
+    int                    split;
+    std::atomic<uint64_t>  total;
+};
+
+static void walk_split( WalkJob& job, Board b, int ply ) {
+    int worker = worker_slot( job.pool );
+    if ( ply >= job.split || ply == job.depth ) {
+        job.total += walk_serial( b, ply, job.depth, job.visit, worker );
+        return;
+    }
+
+    job.visit( b, ply, worker );
+    job.total++;
+
+    MoveArray moves;
+    b.get_legal_moves(moves);
+    for ( auto mov : moves ) {
+        Board    child(b);
+        MoveUndo undo;
+        child.make_move( mov, undo );
+        job.grp.run( [&job, child, ply]{ walk_split( job, child, ply + 1 ); } );
+    }
+}
+
+uint64_t walk_tree( const Board& root, int depth, ThreadPool& pool,
+                    const NodeVisitor& visit, int split_plies ) {
+    TaskGroup grp(pool);
+    WalkJob   job{ pool, grp, visit, depth, split_plies, {0} };
+    walk_split( job, root, 0 );
+    grp.wait();
+    return job.total;
+}
+
+struct PerftJob {
+    TaskGroup&             grp;
+    int                    depth;
+    int                    split;
+    bool                   bulk;
+    PerftTable            *tt;
+    std::atomic<uint64_t>  total;
+};
+
+static void perft_split( PerftJob& job, Board b, int ply ) {
+    // the last couple of plies are not worth a task of their own
+    if ( ply >= job.split || job.depth - ply <= 2 ) {
+        job.total += ( job.tt ) ? perft_hashed( b, job.depth - ply, *job.tt, job.bulk )
+                                : perft( b, job.depth - ply, job.bulk );
+        return;
+    }
+
+    MoveArray moves;
+    b.get_legal_moves(moves);
+    for ( auto mov : moves ) {
+        Board    child(b);
+        MoveUndo undo;
+        child.make_move( mov, undo );
+        job.grp.run( [&job, child, ply]{ perft_split( job, child, ply + 1 ); } );
+    }
+}
+
+uint64_t perft_parallel( const Board& root, int depth, ThreadPool& pool,
+                         bool bulk, int split_plies, PerftTable *tt ) {
+    TaskGroup grp(pool);
+    PerftJob  job{ grp, depth, split_plies, bulk, tt, {0} };
+    perft_split( job, root, 0 );
+    grp.wait();
+    return job.total;
+}
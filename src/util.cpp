@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include "constants.h"
 #include "util.h"
 
@@ -19,3 +21,28 @@ std::vector<std::string> split(std::string target, std::string delimiter) {
     }
     return v;
 }
+
+bool write_all( int fd, const void *buf, size_t len ) {
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    while ( len ) {
+        ssize_t n = ::write( fd, p, len );
+        if ( n <= 0 )
+            return false;
+        p   += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool pwrite_all( int fd, const void *buf, size_t len, uint64_t off ) {
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    while ( len ) {
+        ssize_t n = ::pwrite( fd, p, len, off );
+        if ( n <= 0 )
+            return false;
+        p   += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#include "zobrist.h"
+
+// splitmix64 - small, fast and good enough to fill a key table
+static constexpr uint64_t splitmix( uint64_t& s ) {
+    uint64_t z = ( s += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+    return z ^ ( z >> 31 );
+}
+
+static constexpr ZobristKeys make_zobrist_keys() {
+    ZobristKeys keys{};
+    uint64_t    seed = 0x4c6f726447617274ULL;
+    // byte 0 is an empty square, and 8 is an empty 'black' square -
+    // neither ever appears on the board, so they hash to nothing.
+    for ( int by(0); by < 16; ++by )
+        for ( int idx(0); idx < 64; ++idx )
+            keys.piece[by][idx] = ( by & 0x07 ) ? splitmix(seed) : 0;
+    for ( auto& k : keys.castle )
+        k = splitmix(seed);
+    for ( auto& k : keys.en_passant )
+        k = splitmix(seed);
+    keys.on_move = splitmix(seed);
+    return keys;
+}
+
+// constant-initialized, so usable from any static initializer
+constexpr ZobristKeys zobrist = make_zobrist_keys();